@@ -6,15 +6,37 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <shader.h>
+#include <shadervariants.h>
 #include <camera.h>
 #include <model.h>
+#include <headless.h>
+#include <benchmark.h>
+#include <gputimer.h>
+#include <glstate.h>
+#include <profiler.h>
+#include <threadpool.h>
+#include <uniformblocks.h>
+#include <geometryarena.h>
+#include <lodselect.h>
+#include <globject.h>
+#include <memoryusage.h>
+#include <texturecache.h>
+#include <asteroidbelt.h>
+#include <frustum.h>
+#include <skinning.h>
+#include <assetloader.h>
+#include <stagingbuffer.h>
 
 #include <stb_image.h>
 
 #include <iostream>
+#include <cstring>
+#include <memory>
 
+#ifndef DEMO_NO_AUDIO
 #include <irrklang/irrKlang.h>
 using namespace irrklang;
+#endif
 
 
 //define all texture beforehand
@@ -27,22 +49,52 @@ struct Textures
     unsigned int rockTexture;
 } textures;
 
+//render passes timed on the GPU, in the order they are drawn
+enum GpuPass
+{
+    PASS_WILD,
+    PASS_SCENE,
+    PASS_PLANET,
+    PASS_ASTEROIDS,
+    PASS_SKYBOX,
+    PASS_RESOLVE
+};
+GpuTimer gpuTimer({ "wild", "scene", "planet", "asteroids", "skybox", "resolve" });
+
+//camera and light uniform blocks, uploaded once per frame
+FrameUniforms frameUniforms;
+
+//vertex arrays of the built-in shapes, made on first use by renderQuad() and friends
+struct Shapes
+{
+    GLVertexArray quadVAO, cubeVAO, planeVAO, skyboxVAO;
+    GLBuffer quadVBO, cubeVBO, planeVBO, skyboxVBO;
+} shapes;
+
 //func
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 glm::vec3 move_to_pos(glm::vec3 position, glm::vec3 endPoint, float speed);
-unsigned int loadTexture(char const* path);
+TextureHandle loadTexture(char const* path);
 void renderQuad();
 void renderCube();
+bool cubeVisible(const Frustum& frustum, const glm::mat4& model);
 void renderPlane();
-void renderScene(const Shader& shader, Textures& textures);
-void initPlanet(const Shader& shader);
-void wildTransforms(const Shader& shader, Textures& textures);
-void drawLamps(const Shader& lampShader, glm::vec3 pointLightPos[], glm::vec3 pointLightColors[]);
-unsigned int loadCubemap(vector<std::string> faces);
+void renderScene(const Shader& shader, GLint modelLoc, Textures& textures, const Frustum& frustum);
+glm::mat4 initPlanet(LightsBlock& lights);
+void wildTransforms(const Shader& shader, GLint shearLoc, GLint modelLoc, Textures& textures, const Frustum& frustum);
+void drawLamps(const Shader& lampShader, GLint modelLoc, GLint colorLoc, glm::vec3 pointLightPos[], glm::vec3 pointLightColors[], const Frustum& frustum);
+GLTexture loadCubemap(vector<std::string> faces);
+GLTexture placeholderTexture(unsigned char red, unsigned char green, unsigned char blue);
+GLTexture placeholderCubemap(unsigned char red, unsigned char green, unsigned char blue);
 void renderSkyBox();
+double getTime();
+bool shouldClose(GLFWwindow* window);
+void setShouldClose(GLFWwindow* window);
+void vertexFormatBenchmark(Shader& shader, unsigned int fbo, Benchmark& benchmark);
+void skinningBenchmark(ShaderVariants& litShaders, const std::string& path, unsigned int fbo, Benchmark& benchmark);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -62,44 +114,213 @@ float runTime = 0.0f;
 //debug
 bool wireframe;
 
+//headless: no window, the timeline is rendered offscreen into hdrFBO and resolved into outputFBO
+bool headless = false;
+bool headlessClose = false;
+#ifdef DEMO_HEADLESS
+HeadlessContext headlessContext;
+HeadlessContext uploadContext;   // the asset loader's, in headlessContext's share group
+#endif
 
 
-int main()
-{
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+int main(int argc, char* argv[])
+{
+    //benchmark: fixed timestep replay of the whole timeline, frame times are written as JSON
+    bool benchmarkMode = false;
+    double fixedStep = 1.0 / 60.0;
+    std::string benchmarkOut = "benchmark.json";
+    std::string compareBaseline;
+    double compareThreshold = 10.0;
+    //profiler: chrome trace of the CPU zones, written on exit
+    std::string profileOut;
+    //vertex layout of the planet, and the float vs packed draw throughput comparison run before the timeline
+    VertexFormat planetFormat = VERTEX_FLOAT;
+    bool vertexBenchmark = false;
+    //lay down the planet's depth from a position-only stream first, the lit pass then shades visible fragments only
+    bool depthPrepass = false;
+    //Assimp post-processing of the planet, see importprofile.h
+    ImportProfile planetProfile = IMPORT_RENDER_OPTIMAL;
+    //draw static models from one shared vertex/index buffer with multi-draw indirect, see geometryarena.h
+    bool useGeometryArena = true;
+    //rocks in the instanced belt around the planet, 0 leaves it out
+    unsigned int asteroidCount = 20000;
+    //animated model whose characters are skinned on the GPU and on the CPU before the timeline, see skinning.h
+    std::string skinningModel;
+    //load every asset before the first frame instead of on the loader thread behind placeholders, see assetloader.h
+    bool syncLoading = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(argv[i], "--benchmark") == 0)
+            benchmarkMode = true;
+        else if (std::strcmp(argv[i], "--step") == 0 && i + 1 < argc)
+            fixedStep = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            benchmarkOut = argv[++i];
+        else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+        {
+            benchmarkMode = true;
+            compareBaseline = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            compareThreshold = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profileOut = argv[++i];
+        else if (std::strcmp(argv[i], "--no-shader-cache") == 0)
+            ShaderCache::enabled() = false;
+        else if (std::strcmp(argv[i], "--no-mesh-cache") == 0)
+            MeshCache::enabled() = false;
+        else if (std::strcmp(argv[i], "--no-mesh-optimize") == 0)
+            MeshOptimizer::enabled() = false;
+        else if (std::strcmp(argv[i], "--packed-vertices") == 0)
+            planetFormat = VERTEX_PACKED;
+        else if (std::strcmp(argv[i], "--vertex-benchmark") == 0)
+            vertexBenchmark = true;
+        else if (std::strcmp(argv[i], "--depth-prepass") == 0)
+            depthPrepass = true;
+        else if (std::strcmp(argv[i], "--import-threads") == 0 && i + 1 < argc)
+            ThreadPool::sharedThreads() = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--no-geometry-arena") == 0)
+            useGeometryArena = false;
+        else if (std::strcmp(argv[i], "--no-multi-draw") == 0)
+            GeometryArena::multiDrawEnabled() = false;
+        else if (std::strcmp(argv[i], "--no-lod") == 0)
+            LodSelector::enabled() = false;
+        else if (std::strcmp(argv[i], "--lod-hard") == 0)
+            LodSelector::transition() = LOD_HARD;
+        else if (std::strcmp(argv[i], "--lod-pixels") == 0 && i + 1 < argc)
+            LodSelector::pixelError() = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--keep-cpu-copies") == 0)
+            Mesh::keepCpuCopies() = true;
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            TextureCache::enabled() = false;
+        else if (std::strcmp(argv[i], "--asteroids") == 0 && i + 1 < argc)
+            asteroidCount = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--no-culling") == 0)
+            Frustum::enabled() = false;
+        else if (std::strcmp(argv[i], "--skinning-benchmark") == 0 && i + 1 < argc)
+            skinningModel = argv[++i];
+        else if (std::strcmp(argv[i], "--sync-loading") == 0)
+            syncLoading = true;
+        else if (std::strcmp(argv[i], "--import-profile") == 0 && i + 1 < argc && importProfileFromName(argv[i + 1], planetProfile))
+            i++;
+        else
+        {
+            std::cout << "usage: OpenGL_Demo [--headless] [--benchmark] [--step seconds] [--out results.json]" << std::endl;
+            std::cout << "                   [--compare baseline.json] [--threshold percent] [--profile trace.json]" << std::endl;
+            std::cout << "                   [--no-shader-cache] [--no-mesh-optimize] [--packed-vertices] [--vertex-benchmark]" << std::endl;
+            std::cout << "                   [--depth-prepass] [--no-mesh-cache] [--import-threads n]" << std::endl;
+            std::cout << "                   [--import-profile fast-load|render-optimal|debug] [--no-geometry-arena] [--no-multi-draw]" << std::endl;
+            std::cout << "                   [--no-lod] [--lod-hard] [--lod-pixels error] [--keep-cpu-copies]" << std::endl;
+            std::cout << "                   [--no-texture-cache] [--asteroids count] [--no-culling]" << std::endl;
+            std::cout << "                   [--skinning-benchmark animated-model] [--sync-loading]" << std::endl;
+            return -1;
+        }
+    }
+    if (fixedStep <= 0.0)
+        fixedStep = 1.0 / 60.0;
+    Benchmark benchmark(fixedStep);
+    Profiler::setEnabled(!profileOut.empty());
+    int64_t startupBegin = Profiler::now();
+    unsigned int frameCount = 0;
+
+    //closes the window or the headless context when main returns. it is declared before every GL object of main,
+    //so they all free themselves while the context still exists
+    struct ContextCloser {
+        ~ContextCloser()
+        {
+            // the globals holding GL objects go before the context, their destructors would run after it
+            shapes = Shapes();
+            frameUniforms.ID.reset();
+            gpuTimer.release();
+#ifdef DEMO_HEADLESS
+            if (headless)
+            {
+                uploadContext.destroy();
+                headlessContext.destroy();
+                return;
+            }
 #endif
+            // glfw: terminate, clearing all previously allocated GLFW resources.
+            glfwTerminate();
+        }
+    } contextCloser;
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Reverie Beyond Stars", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    GLFWwindow* uploadWindow = NULL;   // hidden, its context shares window's objects with the asset loader
+    GLADloadproc glLoader = NULL;
+    if (headless)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+#ifdef DEMO_HEADLESS
+        // egl: surfaceless context, same GL version and profile as the window
+        // --------------------------------------------------------------------
+        if (!headlessContext.create(3, 3))
+        {
+            headlessContext.destroy();
+            return -1;
+        }
+        glLoader = (GLADloadproc)HeadlessContext::getProcAddress;
+        if (!gladLoadGLLoader(glLoader))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+#else
+        std::cout << "Headless mode is not available in this build" << std::endl;
         return -1;
+#endif
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    //glfwSetCursorPosCallback(window, mouse_callback);
-    //glfwSetScrollCallback(window, scroll_callback);
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // tell GLFW to capture our mouse
-    //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Reverie Beyond Stars", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        if (!syncLoading)
+        {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            uploadWindow = glfwCreateWindow(1, 1, "", NULL, window);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        }
+        //glfwSetCursorPosCallback(window, mouse_callback);
+        //glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        glLoader = (GLADloadproc)glfwGetProcAddress;
+        if (!gladLoadGLLoader(glLoader))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+
+        // don't let vsync cap benchmark frame times
+        if (benchmarkMode)
+            glfwSwapInterval(0);
     }
 
     // configure global opengl state
@@ -113,25 +334,38 @@ int main()
 
 
     // build shaders
+    // all programs are submitted up front and finished on first use,
+    // so the driver compiles them while the textures and the model load
     // ------------------------------------
-    Shader shader("shaders/project.vs", "shaders/project.fs");
-    Shader lampShader("shaders/light_cube.vs", "shaders/light_cube.fs");
-    Shader hdrShader("shaders/hdr.vs", "shaders/hdr.fs");
-    Shader wildShader("shaders/wild.vs", "shaders/wild.fs");
-    Shader skyBoxShader("shaders/skybox.vs", "shaders/skybox.fs");
-
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
+    Shader::enableParallelCompile(glLoader);
+    // the lit shader is built per permutation (see shadervariants.h), every draw picks the cheapest one that fits it
+    ShaderVariants litShaders("shaders/project.vs", "shaders/project.fs", [](Shader& variant) {
+        variant.setInt("material.diffuse", 0);
+        variant.setInt("material.specular", 1);
+        variant.setFloat("material.shininess", 64.0f);
+        variant.setInt("bonePalette", BonePalette::UNIT);
+        frameUniforms.attach(variant);
+    });
+    // the spotlight is aimed at the planet, its cone never reaches the cubes
+    ShaderPermutation sceneLighting;
+    sceneLighting.spotLight = false;
+    litShaders.prepare(sceneLighting);
+    Shader lampShader("shaders/light_cube.vs", "shaders/light_cube.fs", nullptr, true);
+    Shader hdrShader("shaders/hdr.vs", "shaders/hdr.fs", nullptr, true);
+    Shader wildShader("shaders/wild.vs", "shaders/wild.fs", nullptr, true);
+    Shader skyBoxShader("shaders/skybox.vs", "shaders/skybox.fs", nullptr, true);
+    Shader depthShader("shaders/depth.vs", "shaders/depth.fs", nullptr, true);
+    Shader depthDitherShader("shaders/depth.vs", "shaders/depth.fs", nullptr, true, "#define LOD_DITHER 1");
+
+    GLFramebuffer hdrFBO = GLFramebuffer::create();
     // create floating point color buffer
-    unsigned int colorBuffer;
-    glGenTextures(1, &colorBuffer);
-    glBindTexture(GL_TEXTURE_2D, colorBuffer);
+    GLTexture colorBuffer = GLTexture::create();
+    GLState::current().bindTexture(0, GL_TEXTURE_2D, colorBuffer);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // create depth buffer (renderbuffer)
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
+    GLRenderbuffer rboDepth = GLRenderbuffer::create();
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
     // attach buffers
@@ -142,13 +376,82 @@ int main()
         std::cout << "Framebuffer not complete!" << std::endl;
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    // final output target: the default framebuffer, or an offscreen LDR buffer when there is no window
+    GLFramebuffer outputFBO;
+    GLRenderbuffer rboOutput;
+    if (headless)
+    {
+        rboOutput = GLRenderbuffer::create();
+        glBindRenderbuffer(GL_RENDERBUFFER, rboOutput);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+        outputFBO = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rboOutput);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Output framebuffer not complete!" << std::endl;
+        // a surfaceless context has no default viewport
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    }
+
+
+    //placeholders, drawn until the loader hands over the real textures
+    GLTexture greyTexture = placeholderTexture(128, 128, 128);
+    GLTexture blackTexture = placeholderTexture(0, 0, 0);
+    textures.woodTexture = greyTexture;
+    textures.cubeDiffuse = greyTexture;
+    textures.cubeSpecular = blackTexture;
+    textures.wallSpecular = blackTexture;
+    textures.rockTexture = greyTexture;
+    GLTexture skyBoxTexture = placeholderCubemap(0, 0, 13);
+    TextureHandle woodTexture, cubeDiffuse, cubeSpecular, wallSpecular, rockTexture;
+
+    //the planet and the asteroid belt show up once they are loaded, with their shaders and uniform handles
+    std::shared_ptr<Model> planet;
+    std::shared_ptr<AsteroidBelt> asteroids;
+    GeometryArena sceneGeometry(planetFormat);
+    ShaderPermutation planetLighting;
+    ShaderPermutation planetDithered;
+    ShaderPermutation asteroidLighting;
+    asteroidLighting.instanced = true;
+    Shader* planetShader = nullptr;
+    Shader* planetDitherShader = nullptr;
+    Shader* asteroidShader = nullptr;
+    GLint planetShininess = -1, planetModelLoc = -1;
+    GLint ditherShininess = -1, ditherModelLoc = -1, ditherFadeLoc = -1;
+    GLint asteroidModelLoc = -1;
+
+    //files are decoded and uploaded on the loader thread, see assetloader.h. each job's finish step runs between two
+    //frames once the GPU has its uploads. declared after everything the jobs use, so it stops before they go away
+    AssetLoader loader;
+    if (!syncLoading)
+    {
+        bool started = false;
+#ifdef DEMO_HEADLESS
+        if (headless)
+            started = uploadContext.createShared(headlessContext, 3, 3)
+                && loader.start([]() { return uploadContext.makeCurrent(); }, []() { uploadContext.release(); });
+#endif
+        if (uploadWindow)
+            started = loader.start([uploadWindow]() { glfwMakeContextCurrent(uploadWindow); return true; }, []() { glfwMakeContextCurrent(NULL); });
+        if (!started)
+            std::cout << "ERROR::ASSETLOADER::NO_UPLOAD_CONTEXT loading before the first frame" << std::endl;
+    }
 
     //textures
-    unsigned int woodTexture = loadTexture("textures/floor.png");
-    unsigned int cubeDiffuse = loadTexture("textures/container2.png");
-    unsigned int cubeSpecular = loadTexture("textures/container2_specular.png");
-    unsigned int wallSpecular = loadTexture("textures/brickwall_specular.jpg");
-    unsigned int rockTexture = loadTexture("textures/rock.jpg");
+    auto submitTexture = [&loader](const char* path, TextureHandle& handle, unsigned int& slot) {
+        loader.submit([path, &handle, &slot]() {
+            TextureHandle loaded = loadTexture(path);
+            return AssetLoader::Finish([loaded, &handle, &slot]() {
+                handle = loaded;
+                slot = *loaded;
+            });
+        });
+    };
+    submitTexture("textures/floor.png", woodTexture, textures.woodTexture);
+    submitTexture("textures/container2.png", cubeDiffuse, textures.cubeDiffuse);
+    submitTexture("textures/container2_specular.png", cubeSpecular, textures.cubeSpecular);
+    submitTexture("textures/brickwall_specular.jpg", wallSpecular, textures.wallSpecular);
+    submitTexture("textures/rock.jpg", rockTexture, textures.rockTexture);
 
     //skybox
     vector<std::string> faces
@@ -160,26 +463,99 @@ int main()
         "textures/skybox/front.png",
         "textures/skybox/back.png"
     };
-    unsigned int skyBoxTexture = loadCubemap(faces);
-
-    //model
-    Model planet("models/planet/planet.obj");
+    loader.submit([faces, &skyBoxTexture]() {
+        std::shared_ptr<GLTexture> cubemap = std::make_shared<GLTexture>(loadCubemap(faces));
+        return AssetLoader::Finish([cubemap, &skyBoxTexture]() { skyBoxTexture = std::move(*cubemap); });
+    });
+
+    //asteroid belt, a ring two and a half planet radii out. submitted once the planet's size is known
+    auto submitAsteroids = [&](float planetRadius) {
+        loader.submit([&, planetRadius, asteroidCount, planetFormat]() {
+            int64_t asteroidLoadStart = Profiler::now();
+            std::shared_ptr<AsteroidBelt> belt = std::make_shared<AsteroidBelt>("models/rock/rock.obj", asteroidCount,
+                planetRadius * 2.5f, planetRadius * 0.6f, planetRadius * 0.03f, planetFormat);
+            double asteroidLoadMs = (Profiler::now() - asteroidLoadStart) / 1e6;
+            return AssetLoader::Finish([&, belt, asteroidLoadMs]() {
+                belt->setupVertexArrays();
+                asteroidLighting.specularMap = belt->rock.hasTexture(TEXTURE_SPECULAR);
+                asteroidShader = &litShaders.get(asteroidLighting);
+                asteroidModelLoc = asteroidShader->uniform("model");
+                std::cout << "asteroids: " << belt->size() << " rocks, " << belt->triangles() << " triangles, " << belt->bytes()
+                    << " bytes of instances in " << asteroidLoadMs << " ms" << std::endl;
+                benchmark.addStat("asteroids", "instances", belt->size());
+                benchmark.addStat("asteroids", "triangles", (double)belt->triangles());
+                benchmark.addStat("asteroids", "instance_bytes", (double)belt->bytes());
+                asteroids = belt;
+            });
+        });
+    };
 
-    //remember to define new textures to the struct
-    textures.woodTexture = woodTexture;
-    textures.cubeDiffuse = cubeDiffuse;
-    textures.cubeSpecular = cubeSpecular;
-    textures.wallSpecular = wallSpecular;
-    textures.rockTexture = rockTexture;
+    //model, imported and uploaded on the loader thread along with its arena and position stream
+    loader.submit([&, planetFormat, planetProfile, depthPrepass, useGeometryArena, asteroidCount]() {
+        MemoryUsage memoryBeforeLoad = MemoryUsage::current();
+        int64_t planetLoadStart = Profiler::now();
+        std::shared_ptr<Model> model = std::make_shared<Model>("models/planet/planet.obj", false, planetFormat, planetProfile);
+        double planetLoadMs = (Profiler::now() - planetLoadStart) / 1e6;
+        if (useGeometryArena)
+            model->addTo(sceneGeometry);
+        //after addTo() the position stream goes into the arena, which is built last
+        if (depthPrepass)
+            model->enablePositionStream();
+        if (useGeometryArena)
+            sceneGeometry.build();
+        //everything the planet needs is on the GPU now
+        MemoryUsage memoryLoaded = MemoryUsage::current();
+        model->releaseCpuCopies();
+        MemoryUsage::trim();
+        MemoryUsage memoryReleased = MemoryUsage::current();
+        return AssetLoader::Finish([&, model, planetLoadMs, memoryBeforeLoad, memoryLoaded, memoryReleased, useGeometryArena, asteroidCount]() {
+            model->setupVertexArrays();
+            std::cout << "planet loaded in " << planetLoadMs << " ms on " << ThreadPool::shared().size() + 1 << " threads" << std::endl;
+            benchmark.addStat("load", "planet_ms", planetLoadMs);
+            benchmark.addStat("load", "threads", ThreadPool::shared().size() + 1);
+            benchmark.addStat("load", "planet_vertices", (double)model->importStats.vertices);
+            benchmark.addStat("load", "planet_indices", (double)model->importStats.indices);
+            benchmark.addStat("load", "planet_duplicates_removed", (double)model->importStats.duplicatesRemoved());
+            planetLighting.specularMap = model->hasTexture(TEXTURE_SPECULAR);
+            //the planet while it fades between two levels of detail
+            planetDithered = planetLighting;
+            planetDithered.lodDither = true;
+            litShaders.prepare(planetLighting);
+            litShaders.prepare(planetDithered);
+            planetShader = &litShaders.get(planetLighting);
+            planetDitherShader = &litShaders.get(planetDithered);
+            planetShininess = planetShader->uniform("material.shininess");
+            planetModelLoc = planetShader->uniform("model");
+            ditherShininess = planetDitherShader->uniform("material.shininess");
+            ditherModelLoc = planetDitherShader->uniform("model");
+            ditherFadeLoc = planetDitherShader->uniform("lodFade");
+            for (unsigned int level = 0; level < model->lodLevels(); level++)
+                benchmark.addStat("lod", "level" + std::to_string(level) + "_triangles", (double)model->triangles(level));
+            if (useGeometryArena)
+            {
+                bool multiDraw = GeometryArena::multiDrawEnabled() && GeometryArena::multiDrawSupported();
+                std::cout << "geometry arena: " << sceneGeometry.commandCount() << " draws, " << sceneGeometry.bytes() << " bytes, "
+                    << (multiDraw ? "glMultiDrawElementsIndirect" : "glDrawElementsBaseVertex per draw") << std::endl;
+                benchmark.addStat("geometry", "commands", sceneGeometry.commandCount());
+                benchmark.addStat("geometry", "bytes", (double)sceneGeometry.bytes());
+                benchmark.addStat("geometry", "multi_draw", multiDraw ? 1.0 : 0.0);
+            }
+            std::cout << "memory: " << memoryBeforeLoad.residentMb() << " MB resident before loading the planet, " << memoryLoaded.residentMb()
+                << " MB loaded, " << memoryReleased.residentMb() << " MB after " << (Mesh::keepCpuCopies() ? "keeping" : "dropping")
+                << " the CPU copies, peak " << memoryReleased.peakMb() << " MB" << std::endl;
+            benchmark.addStat("memory", "rss_before_load_mb", memoryBeforeLoad.residentMb());
+            benchmark.addStat("memory", "rss_loaded_mb", memoryLoaded.residentMb());
+            benchmark.addStat("memory", "rss_released_mb", memoryReleased.residentMb());
+            benchmark.addStat("memory", "peak_rss_load_mb", memoryReleased.peakMb());
+            benchmark.addStat("memory", "cpu_copies_kept", Mesh::keepCpuCopies() ? 1.0 : 0.0);
+            planet = model;
+            if (asteroidCount > 0)
+                submitAsteroids(model->boundingRadius());
+        });
+    });
 
 
     //set up shaders
-    //basic shader
-    shader.use();
-    shader.setInt("material.diffuse", 0);
-    shader.setInt("material.specular", 1);
-    shader.setFloat("material.shininess", 64.0f);
-
     //lights
     glm::vec3 pointLightPos[] = {
         glm::vec3(5.f,  0.5f,  5.0f),
@@ -196,51 +572,48 @@ int main()
 
     glm::vec3 diffuse = glm::vec3(1.8f, 1.8f, 1.8f);
 
-    // directional light
-    shader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-    shader.setVec3("dirLight.ambient", 0.02f, 0.02f, 0.02f);
-    shader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.2f);
-    shader.setVec3("dirLight.specular", 0.1f, 0.1f, 0.1f);
-
-    // point light 1
-    shader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[0].diffuse", diffuse);
-    shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[0].constant", 1.0f);
-    shader.setFloat("pointLights[0].linear", 0.09);
-    shader.setFloat("pointLights[0].quadratic", 0.032);
-
-    // point light 2
-    shader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[1].diffuse", diffuse);
-    shader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[1].constant", 1.0f);
-    shader.setFloat("pointLights[1].linear", 0.09);
-    shader.setFloat("pointLights[1].quadratic", 0.032);
-
-    // point light 3
-    shader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("pointLights[2].diffuse", diffuse);
-    shader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLights[2].constant", 1.0f);
-    shader.setFloat("pointLights[2].linear", 0.09);
-    shader.setFloat("pointLights[2].quadratic", 0.032);
+    //camera and lights are shared by all programs through uniform blocks
+    frameUniforms.init();
+    frameUniforms.attach(lampShader);
+    frameUniforms.attach(wildShader);
+    frameUniforms.attach(skyBoxShader);
+    frameUniforms.attach(depthShader);
+    frameUniforms.attach(depthDitherShader);
+    LightsBlock& lights = frameUniforms.lights;
 
+    // directional light
+    lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(0.02f, 0.02f, 0.02f);
+    lights.dirLight.diffuse = glm::vec3(0.2f, 0.2f, 0.2f);
+    lights.dirLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
 
+    // point lights, they stay at the origin until the lights act moves them
+    for (unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+    {
+        lights.pointLights[i].ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        lights.pointLights[i].diffuse = diffuse;
+        lights.pointLights[i].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        lights.pointLights[i].constant = 1.0f;
+        lights.pointLights[i].linear = 0.09f;
+        lights.pointLights[i].quadratic = 0.032f;
+    }
 
     //spotlight
     glm::vec3 spotLightPos = glm::vec3(10.0f, 18.0f, 22.0f);
 
-    shader.setVec3("spotLight.position", spotLightPos);
-    shader.setVec3("spotLight.direction", glm::vec3(1.0f, 1.0f, 1.0f));
-    shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    shader.setVec3("spotLight.diffuse", 5.0f, 5.0f, 5.0f);
-    shader.setVec3("spotLight.specular", 0.1f, 0.1f, 0.1f);
-    shader.setFloat("spotLight.constant", 1.0f);
-    shader.setFloat("spotLight.linear", 0.09);
-    shader.setFloat("spotLight.quadratic", 0.032);
-    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(25.0f)));
+    lights.spotLight.position = spotLightPos;
+    lights.spotLight.direction = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    lights.spotLight.diffuse = glm::vec3(5.0f, 5.0f, 5.0f);
+    lights.spotLight.specular = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.spotLight.constant = 1.0f;
+    lights.spotLight.linear = 0.09f;
+    lights.spotLight.quadratic = 0.032f;
+    lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+    lights.spotLight.outerCutOff = glm::cos(glm::radians(25.0f));
+
+    //basic shader, the variants set themselves up
+    Shader& shader = litShaders.get(sceneLighting);
 
     //hdr shader
     hdrShader.use();
@@ -254,9 +627,45 @@ int main()
     skyBoxShader.use();
     skyBoxShader.setInt("skybox", 0);
 
+    //uniform handles used every frame, resolved once so the render loop does no name lookups. the planet's and the
+    //asteroids' are resolved when they arrive
+    const GLint shaderShininess = shader.uniform("material.shininess");
+    const GLint shaderModelLoc = shader.uniform("model");
+    const GLint lampModelLoc = lampShader.uniform("model");
+    const GLint lampColorLoc = lampShader.uniform("color");
+    const GLint wildShearLoc = wildShader.uniform("shear");
+    const GLint wildModelLoc = wildShader.uniform("model");
+    const GLint depthModelLoc = depthShader.uniform("model");
+    const GLint depthDitherModelLoc = depthDitherShader.uniform("model");
+    const GLint depthDitherFadeLoc = depthDitherShader.uniform("lodFade");
+
     //music
-    ISoundEngine* SoundEngine = createIrrKlangDevice();
-    SoundEngine->play2D("music/levelcomplete.wav", true);
+#ifndef DEMO_NO_AUDIO
+    if (!headless)
+    {
+        ISoundEngine* SoundEngine = createIrrKlangDevice();
+        SoundEngine->play2D("music/levelcomplete.wav", true);
+    }
+#endif
+
+    //the benchmarks before the timeline draw with the planet's shader and load models on this thread
+    if (vertexBenchmark || !skinningModel.empty())
+        loader.wait();
+    if (vertexBenchmark)
+        vertexFormatBenchmark(*planetShader, hdrFBO, benchmark);
+    if (!skinningModel.empty())
+        skinningBenchmark(litShaders, skinningModel, hdrFBO, benchmark);
+
+    gpuTimer.init();
+    //only count the state changes of the frames
+    GLState::current().resetCounters();
+    double lastReadout = 0.0;
+    //objects tested against the view frustum and culled, summed over the frames
+    Frustum::Counters cullingTotals;
+    unsigned int cullingFrames = 0;
+    //from the start of main to the end of the first frame and to the last asset's finish step
+    double firstFrameMs = 0.0;
+    double assetsReadyMs = 0.0;
 
     //vars
     glm::vec3 cameraTarget = glm::vec3(20.0f, 20.0f, 20.0f);
@@ -267,20 +676,68 @@ int main()
     float alpha = 0.0f;
     float angle = 5.0f;
 
+    if (Profiler::enabled())
+        Profiler::zone("startup", startupBegin, Profiler::now());
+    if (ShaderCache::savedMs() > 0.0)
+        std::cout << "shader cache: " << ShaderCache::savedMs() << " ms of shader compilation skipped" << std::endl;
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (!shouldClose(window))
     {
+        PROFILE_ZONE("frame");
+        // assets the loader finished replace their placeholders
+        // ------------------------------------------------------
+        loader.poll();
+        if (assetsReadyMs == 0.0 && loader.idle())
+        {
+            assetsReadyMs = (Profiler::now() - startupBegin) / 1e6;
+            const TextureCache& textureCache = TextureCache::shared();
+            std::cout << "assets: every asset in after " << assetsReadyMs << " ms, " << (loader.async() ? "loaded in the background" : "loaded before the first frame") << std::endl;
+            std::cout << "texture cache: " << textureCache.size() << " textures, " << textureCache.hits() << " loads shared, "
+                << textureCache.misses() << " decoded" << std::endl;
+            benchmark.addStat("load", "assets_ready_ms", assetsReadyMs);
+            benchmark.addStat("load", "async", loader.async() ? 1.0 : 0.0);
+            benchmark.addStat("textures", "cached", (double)textureCache.size());
+            benchmark.addStat("textures", "hits", textureCache.hits());
+            benchmark.addStat("textures", "misses", textureCache.misses());
+        }
+        // the benchmark replays the timeline once every asset is in, the frames before only show the placeholders
+        bool timeline = !benchmarkMode || loader.idle();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        runTime = runTime + deltaTime;
+        if (benchmarkMode && timeline)
+        {
+            if (frameCount == 0)
+            {
+                // the counters cover the timeline, not the frames drawn while loading
+                GLState::current().resetCounters();
+                cullingTotals = Frustum::Counters();
+                cullingFrames = 0;
+            }
+            // every run steps through exactly the same frames
+            benchmark.beginFrame();
+            frameCount++;
+            deltaTime = (float)fixedStep;
+            runTime = (float)(frameCount * fixedStep);
+        }
+        else if (benchmarkMode)
+            deltaTime = 0.0f;
+        else
+        {
+            float currentFrame = getTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+            runTime = runTime + deltaTime;
+        }
+
+        gpuTimer.beginFrame();
 
         // input
         // -----
-        processInput(window);
+        if (!headless)
+            processInput(window);
 
         // render
         // ------
@@ -295,15 +752,9 @@ int main()
         //set up
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
-   
-        shader.use();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        shader.setVec3("viewPos", camera.Position);
-
-        
-        
+        glm::vec3 viewPos = camera.Position;
+        bool drawWild = false;
+        bool drawScene = false;
 
 
         //scripts
@@ -333,13 +784,7 @@ int main()
                 view = glm::lookAt(camera.Position, cameraTarget, camera.WorldUp);
             }
 
-
-
-            //wild transform
-            wildShader.use();
-            wildShader.setMat4("projection", projection);
-            wildShader.setMat4("view", view);
-            wildTransforms(wildShader, textures);
+            drawWild = true;
         }
 
         //lights and scene
@@ -347,9 +792,7 @@ int main()
         {
             camera.Position = move_to_pos(camera.Position, glm::vec3(6.0f, 2.5f, 6.0f), 0.1f);
             view = glm::lookAt(camera.Position, glm::vec3(0.0f, 3.5f, 0.0f), camera.WorldUp);
-            shader.use();
-            shader.setMat4("view", view);
-            shader.setVec3("viewPos", camera.Position);
+            viewPos = camera.Position;
 
             //lights
             pointLightPos[0] = glm::vec3(
@@ -376,26 +819,14 @@ int main()
             }
 
 
-            shader.setVec3("pointLights[0].position", pointLightPos[0]);
-            shader.setVec3("pointLights[1].position", pointLightPos[1]);
-            shader.setVec3("pointLights[2].position", pointLightPos[2]);
-            shader.setVec3("pointLights[0].diffuse", pointLightColors[0]);
-            shader.setVec3("pointLights[1].diffuse", pointLightColors[1]);
-            shader.setVec3("pointLights[2].diffuse", pointLightColors[2]);
-            shader.setVec3("pointLights[0].specular", pointLightColors[0] * 1.2f);
-            shader.setVec3("pointLights[1].specular", pointLightColors[1] * 1.2f);
-            shader.setVec3("pointLights[2].specular", pointLightColors[2] * 1.2f);
-            shader.setFloat("material.shininess", 86.0f);
-
-            //scene
-            renderScene(shader, textures);
-
+            for (unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+            {
+                lights.pointLights[i].position = pointLightPos[i];
+                lights.pointLights[i].diffuse = pointLightColors[i];
+                lights.pointLights[i].specular = pointLightColors[i] * 1.2f;
+            }
 
-            //lamps
-            lampShader.use();
-            lampShader.setMat4("projection", projection);
-            lampShader.setMat4("view", view);
-            drawLamps(lampShader, pointLightPos, pointLightColors);
+            drawScene = true;
         }
 
 
@@ -406,47 +837,260 @@ int main()
 
 
         if (runTime > 162)
-            glfwSetWindowShouldClose(window, true);
+            setShouldClose(window);
+
+        glm::mat4 planetModel = initPlanet(lights);
+
+        //one upload for the camera and the whole light set
+        frameUniforms.camera.projection = projection;
+        frameUniforms.camera.view = view;
+        frameUniforms.camera.viewPos = viewPos;
+        frameUniforms.upload();
+
+        //everything completely outside the view is skipped, see frustum.h
+        Frustum frustum(projection * view);
+
+        //wild transform
+        if (drawWild)
+        {
+            gpuTimer.begin(PASS_WILD);
+            wildShader.use();
+            wildTransforms(wildShader, wildShearLoc, wildModelLoc, textures, frustum);
+            gpuTimer.end(PASS_WILD);
+        }
+
+        //lights and scene
+        if (drawScene)
+        {
+            if (planet)
+            {
+                planetShader->use();
+                planetShader->setFloat(planetShininess, 86.0f);
+                planetDitherShader->use();
+                planetDitherShader->setFloat(ditherShininess, 86.0f);
+            }
+            shader.use();
+            shader.setFloat(shaderShininess, 86.0f);
+
+            //scene
+            gpuTimer.begin(PASS_SCENE);
+            renderScene(shader, shaderModelLoc, textures, frustum);
+
+
+            //lamps
+            lampShader.use();
+            drawLamps(lampShader, lampModelLoc, lampColorLoc, pointLightPos, pointLightColors, frustum);
+            gpuTimer.end(PASS_SCENE);
+        }
         
 
-        //draw planet
-        shader.use();
-        shader.setMat4("view", view);
-        initPlanet(shader);
-        planet.Draw(shader);
+        //draw planet, at the level of detail its size on screen needs. while the level changes the old and the new
+        //level are drawn with complementary dither patterns
+        if (planet)
+        {
+            planet->selectLod(planetModel, viewPos, camera.Zoom, (float)SCR_HEIGHT, deltaTime);
+            planet->cull(frustum, planetModel);
+            Profiler::counter("planet lod", planet->lod.level);
+            bool lodFading = planet->lod.fading();
+            gpuTimer.begin(PASS_PLANET);
+            if (depthPrepass)
+            {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                if (lodFading)
+                {
+                    depthDitherShader.use();
+                    depthDitherShader.setMat4(depthDitherModelLoc, planetModel);
+                    depthDitherShader.setFloat(depthDitherFadeLoc, planet->lod.fade());
+                    planet->DrawDepthLevel(planet->lod.previousLevel);
+                    depthDitherShader.setFloat(depthDitherFadeLoc, -planet->lod.fade());
+                }
+                else
+                {
+                    depthShader.use();
+                    depthShader.setMat4(depthModelLoc, planetModel);
+                }
+                planet->DrawDepth();
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                GLState::current().depthFunc(GL_LEQUAL);
+            }
+            if (lodFading)
+            {
+                planetDitherShader->use();
+                planetDitherShader->setMat4(ditherModelLoc, planetModel);
+                planetDitherShader->setFloat(ditherFadeLoc, planet->lod.fade());
+                planet->DrawLevel(*planetDitherShader, planet->lod.previousLevel);
+                planetDitherShader->setFloat(ditherFadeLoc, -planet->lod.fade());
+                planet->Draw(*planetDitherShader);
+            }
+            else
+            {
+                planetShader->use();
+                planetShader->setMat4(planetModelLoc, planetModel);
+                planet->Draw(*planetShader);
+            }
+            if (depthPrepass)
+                GLState::current().depthFunc(GL_LESS);
+            gpuTimer.end(PASS_PLANET);
+        }
+
+        //asteroid belt, tilted a little and turning slowly around the planet
+        if (asteroids)
+        {
+            gpuTimer.begin(PASS_ASTEROIDS);
+            glm::mat4 belt = glm::translate(glm::mat4(1.0f), glm::vec3(planetModel[3]));
+            belt = glm::rotate(belt, glm::radians(15.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            belt = glm::rotate(belt, glm::radians(2.0f) * runTime, glm::vec3(0.0f, 1.0f, 0.0f));
+            if (frustum.visible(belt, asteroids->boundsMin(), asteroids->boundsMax()))
+            {
+                asteroidShader->use();
+                asteroids->draw(*asteroidShader, asteroidModelLoc, belt);
+            }
+            gpuTimer.end(PASS_ASTEROIDS);
+        }
 
         //skybox
-        glDepthFunc(GL_LEQUAL);
+        gpuTimer.begin(PASS_SKYBOX);
+        GLState::current().depthFunc(GL_LEQUAL);
         skyBoxShader.use();
-        skyBoxShader.setMat4("view", view);
-        skyBoxShader.setMat4("projection", projection);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyBoxTexture);
+        GLState::current().bindTexture(0, GL_TEXTURE_CUBE_MAP, skyBoxTexture);
         renderSkyBox();
-        glDepthFunc(GL_LESS);
+        GLState::current().depthFunc(GL_LESS);
+        gpuTimer.end(PASS_SKYBOX);
         
         
         
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
 
         //render framebuffer and convert to hdr
         
+        gpuTimer.begin(PASS_RESOLVE);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         hdrShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
+        GLState::current().bindTexture(0, GL_TEXTURE_2D, colorBuffer);
         renderQuad();
+        gpuTimer.end(PASS_RESOLVE);
+
+        GLState::current().endFrame();
+        Profiler::counter("gl calls issued", GLState::current().lastFrame().totalIssued());
+        Profiler::counter("gl calls elided", GLState::current().lastFrame().totalElided());
+        Profiler::counter("arena submissions", sceneGeometry.takeSubmissions());
+        Profiler::counter("culling tested", frustum.counters().tested);
+        Profiler::counter("culling culled", frustum.counters().culled);
+        cullingTotals.tested += frustum.counters().tested;
+        cullingTotals.culled += frustum.counters().culled;
+        cullingFrames++;
+
+        //gpu pass times in the title bar, refreshed twice a second
+        if (!headless && getTime() - lastReadout > 0.5)
+        {
+            lastReadout = getTime();
+            glfwSetWindowTitle(window, ("Reverie Beyond Stars | GPU " + gpuTimer.readout() + " | " + GLState::current().readout()).c_str());
+        }
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (headless)
+        {
+            glFlush();
+        }
+        else
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        if (firstFrameMs == 0.0)
+        {
+            firstFrameMs = (Profiler::now() - startupBegin) / 1e6;
+            std::cout << "first frame after " << firstFrameMs << " ms" << std::endl;
+            benchmark.addStat("load", "first_frame_ms", firstFrameMs);
+        }
+
+        if (benchmarkMode && timeline)
+        {
+            // include the GPU work of this frame in its time
+            glFinish();
+            benchmark.endFrame(runTime);
+        }
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    glfwTerminate();
-    return 0;
+    //the loader thread and the pool's workers may still be loading and recording zones, stop them before the trace is
+    //read. assets still on their way are dropped
+    Profiler::setEnabled(false);
+    loader.stop();
+    ThreadPool::shared().waitIdle();
+
+    int result = 0;
+    if (!profileOut.empty() && Profiler::write(profileOut))
+        std::cout << "profiler: trace written to " << profileOut << std::endl;
+    if (benchmarkMode)
+    {
+        for (unsigned int i = 0; i < gpuTimer.names.size(); i++)
+        {
+            if (gpuTimer.samples(i) == 0)
+                continue;
+            benchmark.addStat("gpu", gpuTimer.names[i] + "_ms", gpuTimer.mean(i));
+            benchmark.addStat("gpu", gpuTimer.names[i] + "_frames", gpuTimer.samples(i));
+        }
+        //state changes per frame, issued to GL versus dropped by the state cache
+        const GLState& state = GLState::current();
+        if (state.frameCount() > 0)
+        {
+            for (unsigned int i = 0; i < GLState::CALL_KINDS; i++)
+            {
+                benchmark.addStat("state", std::string(GLState::callName(i)) + "_issued", (double)state.totals().issued[i] / state.frameCount());
+                benchmark.addStat("state", std::string(GLState::callName(i)) + "_elided", (double)state.totals().elided[i] / state.frameCount());
+            }
+            benchmark.addStat("state", "issued", (double)state.totals().totalIssued() / state.frameCount());
+            benchmark.addStat("state", "elided", (double)state.totals().totalElided() / state.frameCount());
+        }
+        //objects per frame tested against the view frustum, skipped and drawn
+        if (cullingFrames > 0)
+        {
+            benchmark.addStat("culling", "tested", (double)cullingTotals.tested / cullingFrames);
+            benchmark.addStat("culling", "culled", (double)cullingTotals.culled / cullingFrames);
+            benchmark.addStat("culling", "drawn", (double)cullingTotals.drawn() / cullingFrames);
+            benchmark.addStat("culling", "enabled", Frustum::enabled() ? 1.0 : 0.0);
+        }
+        //resident memory once the timeline ran, the peak includes the load
+        MemoryUsage memorySteady = MemoryUsage::current();
+        benchmark.addStat("memory", "rss_steady_mb", memorySteady.residentMb());
+        benchmark.addStat("memory", "peak_rss_mb", memorySteady.peakMb());
+        if (!benchmark.writeJson(benchmarkOut))
+            result = -1;
+        else if (!compareBaseline.empty() && !Benchmark::compare(benchmarkOut, compareBaseline, compareThreshold))
+            result = 1;
+        std::cout << "benchmark: " << benchmark.frameTimes.size() << " frames written to " << benchmarkOut << std::endl;
+    }
+
+    // the GL objects of main are freed on the way out, contextCloser closes the context after them
+    return result;
+}
+
+// the window and the headless context keep time and the close flag separately, these pick the active one
+// ---------------------------------------------------------------------------------------------------------
+double getTime()
+{
+#ifdef DEMO_HEADLESS
+    if (headless)
+        return headlessContext.getTime();
+#endif
+    return glfwGetTime();
+}
+
+bool shouldClose(GLFWwindow* window)
+{
+    if (headless)
+        return headlessClose;
+    return glfwWindowShouldClose(window);
+}
+
+void setShouldClose(GLFWwindow* window)
+{
+    if (headless)
+        headlessClose = true;
+    else
+        glfwSetWindowShouldClose(window, true);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -468,7 +1112,7 @@ void processInput(GLFWwindow* window)
 
     */
     if (glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS) {
-        glPolygonMode(GL_FRONT_AND_BACK, (wireframe = not wireframe) ? GL_FILL : GL_LINE);
+        GLState::current().polygonMode((wireframe = not wireframe) ? GL_FILL : GL_LINE);
     }
 }
 
@@ -532,42 +1176,43 @@ glm::vec3 move_to_pos(glm::vec3 position, glm::vec3 endPoint, float speed)
     return position;
 }
 
-unsigned int loadTexture(char const* path)
+// 2D texture from a file relative to the working directory, shared through the texture cache
+TextureHandle loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        if (nrComponents == 3)
-            format = GL_RGB;
-        if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    PROFILE_ZONE("loadTexture");
+    TextureParams params;
+    params.magFilter = GL_NEAREST;
+    return TextureCache::shared().load(path, params);
+}
 
-    }
-    else 
-    {
-        std::cout << "Texture failed to load " << path << std::endl;
-    }
+// 1x1 texture of one colour, stands in for a texture the loader hasn't delivered yet
+GLTexture placeholderTexture(unsigned char red, unsigned char green, unsigned char blue)
+{
+    const unsigned char pixel[4] = { red, green, blue, 255 };
+    GLTexture texture = GLTexture::create();
+    GLState::current().bindTexture(0, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
 
-    stbi_image_free(data);
-    return textureID;
+// the same for the skybox, every face one colour
+GLTexture placeholderCubemap(unsigned char red, unsigned char green, unsigned char blue)
+{
+    const unsigned char pixel[4] = { red, green, blue, 255 };
+    GLTexture texture = GLTexture::create();
+    GLState::current().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+    for (unsigned int i = 0; i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
 }
 
-void renderScene(const Shader& shader, Textures& textures)
+void renderScene(const Shader& shader, GLint modelLoc, Textures& textures, const Frustum& frustum)
 {
+    PROFILE_ZONE("renderScene");
     glm::mat4 model = glm::mat4(1.0f);
     
     //glActiveTexture(GL_TEXTURE0);
@@ -581,17 +1226,13 @@ void renderScene(const Shader& shader, Textures& textures)
     
 
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textures.cubeDiffuse);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textures.cubeDiffuse);
+    GLState::current().bindTexture(0, GL_TEXTURE_2D, textures.cubeDiffuse);
+    GLState::current().bindTexture(1, GL_TEXTURE_2D, textures.cubeDiffuse);
 
     if (runTime > 120)
     {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures.rockTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures.rockTexture);
+        GLState::current().bindTexture(0, GL_TEXTURE_2D, textures.rockTexture);
+        GLState::current().bindTexture(1, GL_TEXTURE_2D, textures.rockTexture);
     }
 
     //cube1
@@ -601,8 +1242,11 @@ void renderScene(const Shader& shader, Textures& textures)
     ));
     model = glm::rotate(model, glm::radians(50.0f) * runTime, glm::vec3(0.0f, 1.0f, 1.0f));
     model = glm::scale(model, glm::vec3(0.5f));
-    shader.setMat4("model", model);
-    renderCube();
+    if (cubeVisible(frustum, model))
+    {
+        shader.setMat4(modelLoc, model);
+        renderCube();
+    }
 
     //cube2
     model = glm::mat4(1.0f);
@@ -611,8 +1255,11 @@ void renderScene(const Shader& shader, Textures& textures)
     ));
     model = glm::rotate(model, glm::radians(30.0f) * runTime, glm::vec3(1.0f));
     model = glm::scale(model, glm::vec3(0.6f));
-    shader.setMat4("model", model);
-    renderCube();
+    if (cubeVisible(frustum, model))
+    {
+        shader.setMat4(modelLoc, model);
+        renderCube();
+    }
 
     //cube3
     model = glm::mat4(1.0f);
@@ -621,8 +1268,11 @@ void renderScene(const Shader& shader, Textures& textures)
     ));
     model = glm::rotate(model, glm::radians(60.0f) * runTime, glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
     model = glm::scale(model, glm::vec3(0.25f));
-    shader.setMat4("model", model);
-    renderCube();
+    if (cubeVisible(frustum, model))
+    {
+        shader.setMat4(modelLoc, model);
+        renderCube();
+    }
 
     //cube4
     model = glm::mat4(1.0f);
@@ -631,8 +1281,11 @@ void renderScene(const Shader& shader, Textures& textures)
     ));
     model = glm::rotate(model, glm::radians(60.0f) * runTime, glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
     model = glm::scale(model, glm::vec3(0.4f));
-    shader.setMat4("model", model);
-    renderCube();
+    if (cubeVisible(frustum, model))
+    {
+        shader.setMat4(modelLoc, model);
+        renderCube();
+    }
 
     //cube5
     model = glm::mat4(1.0f);
@@ -641,16 +1294,17 @@ void renderScene(const Shader& shader, Textures& textures)
     ));
     model = glm::rotate(model, glm::radians(60.0f) * runTime, glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
     model = glm::scale(model, glm::vec3(0.4f));
-    shader.setMat4("model", model);
-    renderCube();
+    if (cubeVisible(frustum, model))
+    {
+        shader.setMat4(modelLoc, model);
+        renderCube();
+    }
 }
 
 
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
 void renderQuad()
 {
-    if (quadVAO == 0)
+    if (shapes.quadVAO == 0)
     {
         float quadVertices[] = {
             // positions        // texture Coords
@@ -660,28 +1314,25 @@ void renderQuad()
              1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
         };
         // setup plane VAO
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        shapes.quadVAO = GLVertexArray::create();
+        shapes.quadVBO = GLBuffer::create();
+        GLState::current().bindVertexArray(shapes.quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, shapes.quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::current().bindVertexArray(shapes.quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 
 
-unsigned int cubeVAO = 0;
-unsigned int cubeVBO = 0;
 void renderCube()
 {
     // initialize (if necessary)
-    if (cubeVAO == 0)
+    if (shapes.cubeVAO == 0)
     {
         float vertices[] = {
             // back face
@@ -727,13 +1378,13 @@ void renderCube()
             -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
             -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
         };
-        glGenVertexArrays(1, &cubeVAO);
-        glGenBuffers(1, &cubeVBO);
+        shapes.cubeVAO = GLVertexArray::create();
+        shapes.cubeVBO = GLBuffer::create();
         // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, shapes.cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState::current().bindVertexArray(shapes.cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -741,12 +1392,22 @@ void renderCube()
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::current().bindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    GLState::current().bindVertexArray(shapes.cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+}
+
+//the cube renderCube() draws spans -1..1 on every axis
+const glm::vec3 cubeBoundsMin = glm::vec3(-1.0f);
+const glm::vec3 cubeBoundsMax = glm::vec3(1.0f);
+const float cubeBoundsRadius = std::sqrt(3.0f);
+
+//false if the cube placed by model is completely outside the frustum
+bool cubeVisible(const Frustum& frustum, const glm::mat4& model)
+{
+    return frustum.visible(model, cubeBoundsMin, cubeBoundsMax, glm::vec3(0.0f), cubeBoundsRadius);
 }
 
 
@@ -754,11 +1415,9 @@ void renderCube()
 
 
 
-unsigned int planeVAO = 0;
-unsigned int planeVBO;
 void renderPlane()
 {
-    if (planeVAO == 0)
+    if (shapes.planeVAO == 0)
     {
         float planeVertices[] = {
             // positions            // normals         // texcoords
@@ -772,10 +1431,10 @@ void renderPlane()
 
         };
         // setup plane VAO
-        glGenVertexArrays(1, &planeVAO);
-        glGenBuffers(1, &planeVBO);
-        glBindVertexArray(planeVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
+        shapes.planeVAO = GLVertexArray::create();
+        shapes.planeVBO = GLBuffer::create();
+        GLState::current().bindVertexArray(shapes.planeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, shapes.planeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -783,15 +1442,15 @@ void renderPlane()
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindVertexArray(0);
+        GLState::current().bindVertexArray(0);
     }
-    glBindVertexArray(planeVAO);
+    GLState::current().bindVertexArray(shapes.planeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
 }
 
 glm::vec3 spotLightPos = glm::vec3(25.0f, 20.0f, 30.0f);
-void initPlanet(const Shader& shader) 
+//moves the spotlight that lights the planet and returns the planet's model matrix
+glm::mat4 initPlanet(LightsBlock& lights) 
 {
     if (runTime < 150)
     {
@@ -808,13 +1467,13 @@ void initPlanet(const Shader& shader)
     model = glm::translate(model, planetPos);
     model = glm::rotate(model, glm::radians(10.0f) * runTime, glm::vec3(0.0f, 1.0f, 0.0f));
 
-    shader.setVec3("spotLight.position", spotLightPos);
-    shader.setVec3("spotLight.direction", spotLightDir);
-    shader.setMat4("model", model);
+    lights.spotLight.position = spotLightPos;
+    lights.spotLight.direction = spotLightDir;
+    return model;
 }
 
 
-void wildTransforms(const Shader& shader, Textures& textures)
+void wildTransforms(const Shader& shader, GLint shearLoc, GLint modelLoc, Textures& textures, const Frustum& frustum)
 {
     float a = sin(runTime);
     float b = cos(runTime);
@@ -844,19 +1503,22 @@ void wildTransforms(const Shader& shader, Textures& textures)
     model = glm::translate(model, glm::vec3(0.0f, 1.0f, 0.0f));
 
     if (runTime < 43.5f)
-        shader.setMat4("shear", shear1);
+        shader.setMat4(shearLoc, shear1);
     if (runTime > 43.5f && runTime < 65.2f)
-        shader.setMat4("shear", shear2);
+        shader.setMat4(shearLoc, shear2);
     if (runTime > 65.2f && runTime < 90.0f)
-        shader.setMat4("shear", shear3);
-
-    shader.setMat4("model", model);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textures.wallSpecular);
+        shader.setMat4(shearLoc, shear3);
+
+    //wild.vs shears the cube on both sides of model
+    glm::mat4 shear = runTime < 43.5f ? shear1 : (runTime < 65.2f ? shear2 : shear3);
+    if (!cubeVisible(frustum, shear * model * shear))
+        return;
+    shader.setMat4(modelLoc, model);
+    GLState::current().bindTexture(0, GL_TEXTURE_2D, textures.wallSpecular);
     renderCube();
 }
 
-void drawLamps(const Shader& lampShader, glm::vec3 pointLightPos[], glm::vec3 pointLightColors[])
+void drawLamps(const Shader& lampShader, GLint modelLoc, GLint colorLoc, glm::vec3 pointLightPos[], glm::vec3 pointLightColors[], const Frustum& frustum)
 {
 
 
@@ -867,27 +1529,35 @@ void drawLamps(const Shader& lampShader, glm::vec3 pointLightPos[], glm::vec3 po
         model = glm::mat4(1.0f);
         model = glm::translate(model, pointLightPos[i]);
         model = glm::scale(model, glm::vec3(0.2f));
-        lampShader.setMat4("model", model);
-        lampShader.setVec3("color", pointLightColors[i]);
+        if (!cubeVisible(frustum, model))
+            continue;
+        lampShader.setMat4(modelLoc, model);
+        lampShader.setVec3(colorLoc, pointLightColors[i]);
         renderCube();
     }
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
+// the faces are decoded as RGBA whatever the files hold, that is what the upload reads. on the loader thread the
+// pixels go through its staging buffer (see stagingbuffer.h)
+GLTexture loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    PROFILE_ZONE("loadCubemap");
+    GLTexture textureID = GLTexture::create();
+    GLState::current().bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
+    StagingBuffer* staging = StagingBuffer::current();
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 4);
         if (data)
         {
+            const void* pixels = staging ? staging->stage(data, (size_t)width * height * 4) : data;
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data
+                0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels
             );
+            if (staging)
+                staging->unbind();
             stbi_image_free(data);
         }
         else
@@ -905,11 +1575,9 @@ unsigned int loadCubemap(vector<std::string> faces)
     return textureID;
 }
 
-unsigned int skyboxVAO = 0;
-unsigned int skyboxVBO;
 void renderSkyBox() {
 
-    if (skyboxVAO == 0)
+    if (shapes.skyboxVAO == 0)
     {
         float skyboxVertices[] = {
             // positions          
@@ -956,17 +1624,204 @@ void renderSkyBox() {
          50.0f, -50.0f,  50.0f
         };
 
-        glGenVertexArrays(1, &skyboxVAO);
-        glGenBuffers(1, &skyboxVBO);
-        glBindVertexArray(skyboxVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+        shapes.skyboxVAO = GLVertexArray::create();
+        shapes.skyboxVBO = GLBuffer::create();
+        GLState::current().bindVertexArray(shapes.skyboxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, shapes.skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glBindVertexArray(0);
+        GLState::current().bindVertexArray(0);
     }
-    glBindVertexArray(skyboxVAO);
+    GLState::current().bindVertexArray(shapes.skyboxVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
 }
 
+
+//draws the planet in both vertex layouts many times a frame and reports the draw throughput of each.
+//the planets are drawn small so the vertex work dominates, the best of a few interleaved rounds counts.
+void vertexFormatBenchmark(Shader& shader, unsigned int fbo, Benchmark& benchmark)
+{
+    PROFILE_ZONE("vertexFormatBenchmark");
+    const unsigned int GRID = 8, FRAMES = 30, ROUNDS = 5;
+    const char* names[2] = { "float", "packed" };
+    Model floatPlanet("models/planet/planet.obj", false, VERTEX_FLOAT);
+    Model packedPlanet("models/planet/planet.obj", false, VERTEX_PACKED);
+    Model* models[2] = { &floatPlanet, &packedPlanet };
+
+    //the cooked planet has no CPU copies, its bounds give the size
+    float radius = glm::length(floatPlanet.boundingCentre()) + floatPlanet.boundingRadius();
+    size_t triangles = floatPlanet.triangles(0);
+    if (triangles == 0)
+    {
+        std::cout << "vertex benchmark: the planet has no triangles" << std::endl;
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    frameUniforms.camera.projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    frameUniforms.camera.viewPos = glm::vec3(0.0f, 0.0f, 30.0f);
+    frameUniforms.camera.view = glm::lookAt(frameUniforms.camera.viewPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frameUniforms.upload();
+    shader.use();
+    const GLint modelLoc = shader.uniform("model");
+
+    double best[2] = { 1e30, 1e30 };
+    for (unsigned int round = 0; round < ROUNDS; round++)
+    {
+        for (unsigned int layout = 0; layout < 2; layout++)
+        {
+            glFinish();
+            int64_t start = Profiler::now();
+            for (unsigned int frame = 0; frame < FRAMES; frame++)
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                for (unsigned int x = 0; x < GRID; x++)
+                {
+                    for (unsigned int y = 0; y < GRID; y++)
+                    {
+                        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * x - GRID + 1.0f, 2.0f * y - GRID + 1.0f, 0.0f));
+                        model = glm::scale(model, glm::vec3(0.8f / radius));
+                        shader.setMat4(modelLoc, model);
+                        models[layout]->Draw(shader);
+                    }
+                }
+            }
+            glFinish();
+            best[layout] = std::min(best[layout], (Profiler::now() - start) / 1000000.0 / FRAMES);
+        }
+    }
+
+    for (unsigned int layout = 0; layout < 2; layout++)
+    {
+        double mtris = triangles * GRID * GRID / (best[layout] / 1000.0) / 1000000.0;
+        std::cout << "vertex benchmark: " << names[layout] << " " << models[layout]->vertexBytes() << " bytes of vertices, "
+            << best[layout] << " ms per frame, " << mtris << " Mtris/s" << std::endl;
+        benchmark.addStat("vertex_format", std::string(names[layout]) + "_ms", best[layout]);
+        benchmark.addStat("vertex_format", std::string(names[layout]) + "_bytes", (double)models[layout]->vertexBytes());
+        benchmark.addStat("vertex_format", std::string(names[layout]) + "_mtris", mtris);
+    }
+}
+
+//how many animated characters the GPU path (bones in project.vs) and the CPU path (SIMD skinning on the thread pool)
+//each draw within a 60 fps frame. the count doubles until a frame takes too long, then the limit is narrowed down.
+void skinningBenchmark(ShaderVariants& litShaders, const std::string& path, unsigned int fbo, Benchmark& benchmark)
+{
+    PROFILE_ZONE("skinningBenchmark");
+    const unsigned int FRAMES = 10, MAX_CHARACTERS = 16384, CHUNK = 64;
+    const double BUDGET_MS = 1000.0 / 60.0;
+    const char* names[2] = { "gpu", "cpu" };   //the two skinning methods
+
+    Model character(path);
+    if (!character.skinned() || character.animations.empty())
+    {
+        std::cout << "skinning benchmark: " << path << " has no bones or no animation" << std::endl;
+        return;
+    }
+    const Animation& animation = character.animations[0];
+    const unsigned int bones = character.skeleton.boneCount();
+    CpuSkinner cpuSkinner(character);
+    character.releaseCpuCopies();
+    BonePalette palette;
+
+    ShaderPermutation gpuLighting;
+    gpuLighting.spotLight = false;
+    gpuLighting.specularMap = character.hasTexture(TEXTURE_SPECULAR);
+    gpuLighting.skinned = true;
+    ShaderPermutation cpuLighting = gpuLighting;
+    cpuLighting.skinned = false;
+    Shader* shaders[2] = { &litShaders.get(gpuLighting), &litShaders.get(cpuLighting) };
+    const GLint modelLocs[2] = { shaders[0]->uniform("model"), shaders[1]->uniform("model") };
+    const GLint boneBaseLoc = shaders[0]->uniform("boneBase");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    float scale = 1.0f / std::max(character.boundingRadius(), 1e-6f);
+    std::vector<glm::mat4> palettes;
+
+    //ms per frame of count characters in a square grid, each a little further into the clip than the one before
+    auto measure = [&](unsigned int method, unsigned int count) {
+        unsigned int side = (unsigned int)std::ceil(std::sqrt((double)count));
+        frameUniforms.camera.projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+        frameUniforms.camera.viewPos = glm::vec3(0.0f, 0.0f, side * 1.1f / std::tan(glm::radians(22.5f)) + 2.0f);
+        frameUniforms.camera.view = glm::lookAt(frameUniforms.camera.viewPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        frameUniforms.upload();
+        palettes.resize((size_t)count * bones);
+
+        glFinish();
+        int64_t start = Profiler::now();
+        for (unsigned int frame = 0; frame < FRAMES; frame++)
+        {
+            float time = frame / 60.0f;
+            ThreadPool::shared().parallelFor((count + CHUNK - 1) / CHUNK, [&](size_t chunk) {
+                std::vector<glm::mat4> globals;
+                for (size_t i = chunk * CHUNK; i < std::min((size_t)count, (chunk + 1) * CHUNK); i++)
+                    animation.sample(time + i * 0.37f, character.skeleton, &palettes[i * bones], globals);
+            });
+            if (method == 0)
+            {
+                palette.upload(palettes);
+                palette.bind();
+            }
+            else
+                cpuSkinner.skin(palettes.data(), bones, count);
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            shaders[method]->use();
+            for (unsigned int i = 0; i < count; i++)
+            {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(2.2f * (i % side) - 1.1f * (side - 1), 2.2f * (i / side) - 1.1f * (side - 1), 0.0f));
+                model = glm::scale(model, glm::vec3(scale));
+                model = glm::translate(model, -character.boundingCentre());
+                shaders[method]->setMat4(modelLocs[method], model);
+                if (method == 0)
+                {
+                    shaders[method]->setInt(boneBaseLoc, (int)(i * bones));
+                    character.DrawLevel(*shaders[method], 0);
+                }
+                else
+                    cpuSkinner.draw(*shaders[method], i);
+            }
+        }
+        glFinish();
+        return (Profiler::now() - start) / 1000000.0 / FRAMES;
+    };
+
+    for (unsigned int method = 0; method < 2; method++)
+    {
+        unsigned int sustained = 0, failed = 0;
+        double sustainedMs = 0.0;
+        for (unsigned int count = 1; count <= MAX_CHARACTERS; count *= 2)
+        {
+            double ms = measure(method, count);
+            if (ms > BUDGET_MS)
+            {
+                failed = count;
+                break;
+            }
+            sustained = count;
+            sustainedMs = ms;
+        }
+        //bisect down to a sixteenth of the limit
+        while (failed && failed - sustained > std::max(1u, sustained / 16))
+        {
+            unsigned int count = sustained + (failed - sustained) / 2;
+            double ms = measure(method, count);
+            if (ms > BUDGET_MS)
+                failed = count;
+            else
+            {
+                sustained = count;
+                sustainedMs = ms;
+            }
+        }
+        std::cout << "skinning benchmark: " << names[method] << " " << sustained << (failed ? "" : "+") << " characters at 60 fps, "
+            << sustainedMs << " ms per frame" << std::endl;
+        benchmark.addStat("skinning", std::string(names[method]) + "_characters", sustained);
+        benchmark.addStat("skinning", std::string(names[method]) + "_ms", sustainedMs);
+    }
+    std::cout << "skinning benchmark: " << bones << " bones, " << cpuSkinner.vertexCount() << " vertices per character, "
+        << ThreadPool::shared().size() + 1 << " threads" << (SKINNING_SSE ? ", SSE" : "") << std::endl;
+    benchmark.addStat("skinning", "bones", bones);
+    benchmark.addStat("skinning", "vertices", (double)cpuSkinner.vertexCount());
+    benchmark.addStat("skinning", "threads", ThreadPool::shared().size() + 1);
+}
@@ -0,0 +1,232 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assimp stores matrices row by row, glm column by column
+inline glm::mat4 toGlm(const aiMatrix4x4& matrix)
+{
+    return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
+// The node hierarchy of a scene with the bones of its meshes. Nodes are stored parents first, so one pass from the
+// front turns local transforms into global ones. A bone is a node that moves vertices, its offset matrix takes
+// mesh space into the bone's space at the bind pose.
+class Skeleton
+{
+public:
+    struct Node {
+        std::string name;
+        int parent;             // -1 for the root
+        int bone;               // index into offsets, -1 if no vertex follows the node
+        glm::mat4 transform;    // relative to the parent, used where no animation channel drives the node
+    };
+
+    std::vector<Node> nodes;
+    std::vector<glm::mat4> offsets;   // per bone
+    glm::mat4 globalInverse = glm::mat4(1.0f);
+
+    Skeleton() = default;
+
+    // the nodes of scene and every bone of its meshes, empty when no mesh has bones
+    explicit Skeleton(const aiScene* scene)
+    {
+        for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+        {
+            const aiMesh* mesh = scene->mMeshes[m];
+            for (unsigned int b = 0; b < mesh->mNumBones; b++)
+            {
+                std::string name = mesh->mBones[b]->mName.C_Str();
+                if (boneIds.count(name))
+                    continue;
+                boneIds[name] = (int)offsets.size();
+                offsets.push_back(toGlm(mesh->mBones[b]->mOffsetMatrix));
+            }
+        }
+        if (offsets.empty())
+            return;
+        addNode(scene->mRootNode, -1);
+        globalInverse = glm::inverse(toGlm(scene->mRootNode->mTransformation));
+        // a bone the hierarchy doesn't have stays at the bind pose
+        for (const auto& bone : boneIds)
+        {
+            if (nodeIds.count(bone.first))
+                continue;
+            std::cout << "ERROR::SKELETON::BONE_WITHOUT_NODE " << bone.first << std::endl;
+            nodeIds[bone.first] = (int)nodes.size();
+            nodes.push_back({ bone.first, -1, bone.second, glm::inverse(globalInverse * offsets[bone.second]) });
+        }
+    }
+
+    bool empty() const
+    {
+        return offsets.empty();
+    }
+
+    unsigned int boneCount() const
+    {
+        return (unsigned int)offsets.size();
+    }
+
+    // -1 for names that aren't bones or nodes
+    int boneIndex(const std::string& name) const
+    {
+        auto bone = boneIds.find(name);
+        return bone == boneIds.end() ? -1 : bone->second;
+    }
+
+    int nodeIndex(const std::string& name) const
+    {
+        auto node = nodeIds.find(name);
+        return node == nodeIds.end() ? -1 : node->second;
+    }
+
+private:
+    std::unordered_map<std::string, int> boneIds;
+    std::unordered_map<std::string, int> nodeIds;
+
+    void addNode(const aiNode* node, int parent)
+    {
+        int index = (int)nodes.size();
+        std::string name = node->mName.C_Str();
+        nodes.push_back({ name, parent, boneIndex(name), toGlm(node->mTransformation) });
+        nodeIds[name] = index;
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            addNode(node->mChildren[i], index);
+    }
+};
+
+// One clip of an aiAnimation: per node, keyframes of translation, rotation and scale. sample() interpolates them at a
+// time, nodes without a channel keep their Skeleton transform, and turns the pose into the bone palette the
+// skinning reads: palette[bone] = globalInverse * global node transform * offset.
+class Animation
+{
+public:
+    std::string name;
+    float duration = 0.0f;          // in ticks
+    float ticksPerSecond = 25.0f;
+
+    Animation(const aiAnimation* animation, const Skeleton& skeleton)
+        : name(animation->mName.C_Str()), duration((float)animation->mDuration)
+    {
+        if (animation->mTicksPerSecond > 0.0)
+            ticksPerSecond = (float)animation->mTicksPerSecond;
+        for (unsigned int c = 0; c < animation->mNumChannels; c++)
+        {
+            const aiNodeAnim* source = animation->mChannels[c];
+            Channel channel;
+            channel.node = skeleton.nodeIndex(source->mNodeName.C_Str());
+            if (channel.node < 0)
+                continue;
+            for (unsigned int k = 0; k < source->mNumPositionKeys; k++)
+            {
+                const aiVectorKey& key = source->mPositionKeys[k];
+                channel.positions.push_back({ (float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+            }
+            for (unsigned int k = 0; k < source->mNumRotationKeys; k++)
+            {
+                const aiQuatKey& key = source->mRotationKeys[k];
+                channel.rotations.push_back({ (float)key.mTime, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z) });
+            }
+            for (unsigned int k = 0; k < source->mNumScalingKeys; k++)
+            {
+                const aiVectorKey& key = source->mScalingKeys[k];
+                channel.scales.push_back({ (float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+            }
+            channels.push_back(std::move(channel));
+        }
+    }
+
+    float seconds() const
+    {
+        return duration / ticksPerSecond;
+    }
+
+    // the bone palette of skeleton at time seconds into the clip, which loops. palette gets one matrix per bone,
+    // globals is scratch space with one per node, both are resized as needed.
+    void sample(float time, const Skeleton& skeleton, glm::mat4* palette, std::vector<glm::mat4>& globals) const
+    {
+        float ticks = duration > 0.0f ? std::fmod(time * ticksPerSecond, duration) : 0.0f;
+        if (ticks < 0.0f)
+            ticks += duration;
+
+        globals.resize(skeleton.nodes.size());
+        for (size_t i = 0; i < skeleton.nodes.size(); i++)
+            globals[i] = skeleton.nodes[i].transform;
+        for (const Channel& channel : channels)
+        {
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), interpolate(channel.positions, ticks, glm::vec3(0.0f)));
+            local *= glm::mat4_cast(interpolate(channel.rotations, ticks, glm::quat(1.0f, 0.0f, 0.0f, 0.0f)));
+            globals[channel.node] = glm::scale(local, interpolate(channel.scales, ticks, glm::vec3(1.0f)));
+        }
+        // parents come first, their globals are done when a child reaches them
+        for (size_t i = 0; i < skeleton.nodes.size(); i++)
+        {
+            const Skeleton::Node& node = skeleton.nodes[i];
+            if (node.parent >= 0)
+                globals[i] = globals[node.parent] * globals[i];
+            if (node.bone >= 0)
+                palette[node.bone] = skeleton.globalInverse * globals[i] * skeleton.offsets[node.bone];
+        }
+    }
+
+    void sample(float time, const Skeleton& skeleton, std::vector<glm::mat4>& palette, std::vector<glm::mat4>& globals) const
+    {
+        palette.resize(skeleton.boneCount());
+        sample(time, skeleton, palette.data(), globals);
+    }
+
+private:
+    template <typename T>
+    struct Key {
+        float time;
+        T value;
+    };
+
+    struct Channel {
+        int node;
+        std::vector<Key<glm::vec3>> positions;
+        std::vector<Key<glm::quat>> rotations;
+        std::vector<Key<glm::vec3>> scales;
+    };
+    std::vector<Channel> channels;
+
+    static glm::vec3 blend(const glm::vec3& a, const glm::vec3& b, float t)
+    {
+        return glm::mix(a, b, t);
+    }
+
+    static glm::quat blend(const glm::quat& a, const glm::quat& b, float t)
+    {
+        return glm::normalize(glm::slerp(a, b, t));
+    }
+
+    // the value at ticks between the two keys around it, the first and last key hold before and after
+    template <typename T>
+    static T interpolate(const std::vector<Key<T>>& keys, float ticks, const T& none)
+    {
+        if (keys.empty())
+            return none;
+        auto next = std::upper_bound(keys.begin(), keys.end(), ticks, [](float time, const Key<T>& key) { return time < key.time; });
+        if (next == keys.begin())
+            return keys.front().value;
+        if (next == keys.end())
+            return keys.back().value;
+        auto previous = next - 1;
+        float span = next->time - previous->time;
+        float t = span > 0.0f ? (ticks - previous->time) / span : 0.0f;
+        return blend(previous->value, next->value, t);
+    }
+};
+#endif
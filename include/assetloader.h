@@ -0,0 +1,265 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <glad/glad.h>
+
+#include <glstate.h>
+#include <stagingbuffer.h>
+#include <profiler.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Fixed size ring between exactly one producer and one consumer thread, neither of them ever takes a lock.
+// The producer push()es, the consumer looks at front() and pop()s it once done with it.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+public:
+    // false when the ring is full, value is left alone then
+    bool push(T& value)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % Capacity;
+        if (next == headIndex.load(std::memory_order_acquire))
+            return false;
+        slots[tail] = std::move(value);
+        tailIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // the oldest entry, null when the ring is empty
+    T* front()
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[head];
+    }
+
+    void pop()
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        slots[head] = T();
+        headIndex.store((head + 1) % Capacity, std::memory_order_release);
+    }
+
+private:
+    T slots[Capacity];
+    std::atomic<size_t> headIndex{ 0 };
+    std::atomic<size_t> tailIndex{ 0 };
+};
+
+// Loads assets on a thread of its own with a second GL context in the render context's share group, so files are
+// decoded and uploaded while the render loop keeps drawing. A job runs on the loader thread and returns the step that
+// finishes it on the render thread, e.g. swapping a placeholder for the real texture. Behind every job the loader
+// puts a fence; poll(), called by the render thread once a frame, runs the finish step of every job whose fence has
+// signalled, in submission order, and never waits. Finished jobs come over through an SpscRing.
+// Buffers, textures and programs are shared between the contexts, vertex arrays are not: the upload context is
+// GLState::uploadOnly(), meshes and arenas made there leave their vertex arrays to the finish step (see
+// Model::setupVertexArrays()). Texture uploads go through the loader's StagingBuffer.
+// The render context only sees an object's new contents once it binds it after the fence, finish steps hand objects
+// over and never draw with them on the loader's behalf.
+// Without start(), or when it fails, submit() runs the job and its finish step on the calling thread right away.
+//
+//     loader.start([]() { return upload.makeCurrent(); }, []() { upload.release(); });
+//     loader.submit([]() {
+//         TextureHandle texture = loadTexture("textures/floor.png");
+//         return AssetLoader::Finish([texture]() { floorTexture = texture; });
+//     });
+//     while (running) { loader.poll(); draw(); }
+class AssetLoader
+{
+public:
+    // runs on the render thread once the job's GL work is done
+    typedef std::function<void()> Finish;
+    // runs on the loader thread with the upload context current
+    typedef std::function<Finish()> Job;
+
+    AssetLoader() {}
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // jobs not started yet are dropped, the render context has to outlive the loader
+    ~AssetLoader()
+    {
+        stop();
+    }
+
+    // starts the loader thread. makeCurrent runs on it first and has to make the upload context current, false
+    // leaves the loader synchronous. release runs on it last, after the loader's own GL objects are gone.
+    bool start(std::function<bool()> makeCurrent, std::function<void()> release)
+    {
+        if (worker.joinable())
+            return running;
+        starting = true;
+        worker = std::thread([this, makeCurrent, release]() { run(makeCurrent, release); });
+        std::unique_lock<std::mutex> lock(mutex);
+        started.wait(lock, [this]() { return !starting; });
+        return running;
+    }
+
+    // true when jobs run on the loader thread
+    bool async() const
+    {
+        return running;
+    }
+
+    void submit(Job job)
+    {
+        if (!running)
+        {
+            Finish finish = job();
+            if (finish)
+                finish();
+            return;
+        }
+        outstanding++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // runs the finish step of every job the GPU is done with, oldest first, and returns how many. render thread
+    // only, finish steps may submit() further jobs.
+    unsigned int poll()
+    {
+        unsigned int finished = 0;
+        while (Completion* done = completed.front())
+        {
+            if (glClientWaitSync(done->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(done->fence);
+            Finish finish = std::move(done->finish);
+            completed.pop();
+            outstanding--;
+            finished++;
+            PROFILE_ZONE("AssetLoader::finish");
+            if (finish)
+                finish();
+        }
+        return finished;
+    }
+
+    // polls until every submitted job is finished, for code that can't go on without the assets
+    void wait()
+    {
+        while (outstanding > 0)
+        {
+            if (poll() == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    // jobs submitted and not finished yet
+    unsigned int pending() const
+    {
+        return outstanding;
+    }
+
+    bool idle() const
+    {
+        return outstanding == 0;
+    }
+
+    // finishes the job in progress and drops the rest, done jobs lose their finish steps. render thread only, the
+    // loader is synchronous afterwards. the destructor does this too.
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        wake.notify_all();
+        worker.join();
+        while (Completion* done = completed.front())
+        {
+            glDeleteSync(done->fence);
+            completed.pop();
+        }
+        outstanding = 0;
+        running = false;
+    }
+
+private:
+    // a job done on the loader thread, its fence follows its GL commands
+    struct Completion {
+        GLsync fence = nullptr;
+        Finish finish;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;       // jobs or stopping
+    std::condition_variable started;    // run() made the context current or gave up
+    std::deque<Job> jobs;
+    SpscRing<Completion, 64> completed;
+    std::atomic<bool> stopping{ false };
+    bool starting = false;
+    bool running = false;
+    unsigned int outstanding = 0;       // render thread only
+
+    void run(std::function<bool()> makeCurrent, std::function<void()> release)
+    {
+        bool current = makeCurrent();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = current;
+            starting = false;
+        }
+        started.notify_all();
+        if (!current)
+            return;
+
+        GLState::current().setUploadOnly(true);
+        {
+            StagingBuffer staging;
+            StagingBuffer::current() = &staging;
+            for (;;)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                    if (stopping)
+                        break;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                // the render thread may have deleted objects whose names this context still thinks bound
+                GLState::current().invalidate();
+                Completion done;
+                {
+                    PROFILE_ZONE("AssetLoader::job");
+                    done.finish = job();
+                }
+                done.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                // the fence has to reach the GPU before another context can see it signal
+                glFlush();
+                while (!completed.push(done))
+                {
+                    if (stopping)
+                    {
+                        glDeleteSync(done.fence);
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+            StagingBuffer::current() = nullptr;
+        }
+        release();
+    }
+};
+#endif
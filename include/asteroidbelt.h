@@ -0,0 +1,125 @@
+#ifndef ASTEROIDBELT_H
+#define ASTEROIDBELT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <model.h>
+#include <shader.h>
+#include <globject.h>
+#include <profiler.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+// A ring of copies of one model, e.g. rocks around the planet, drawn with one glDrawElementsInstanced per mesh.
+// The instance matrices are scattered once with a fixed seed, so every run draws the same belt, and live in a
+// GL_ARRAY_BUFFER the model's VAOs read at attributes 5-8. They place a rock inside the belt, the shader's model
+// uniform places and turns the whole belt. The lit shader needs the instanced permutation (see shadervariants.h).
+//
+//     AsteroidBelt belt("models/rock/rock.obj", 50000, planetRadius * 2.5f, planetRadius * 0.5f, planetRadius * 0.02f);
+//     belt.draw(shader, modelLoc, glm::translate(glm::mat4(1.0f), planetPos));
+class AsteroidBelt
+{
+public:
+    Model rock;
+
+    // count rocks at radius from the centre, spread width across the ring and a tenth of that up and down.
+    // rockSize is the largest rock's radius, the smallest is a fifth of it.
+    AsteroidBelt(const std::string& modelPath, unsigned int count, float radius, float width, float rockSize, VertexFormat format = VERTEX_FLOAT)
+        : rock(modelPath, false, format),
+          extent(radius + width * 0.5f + rockSize, width * 0.05f + rockSize, radius + width * 0.5f + rockSize)
+    {
+        PROFILE_ZONE("AsteroidBelt::AsteroidBelt");
+        if (rock.meshes.empty())
+            return;
+        instances = scatter(count, radius, width, rockSize / std::max(rock.boundingRadius(), 1e-6f), rock.boundingCentre());
+        instanceBuffer = GLBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::mat4), instances.data(), GL_STATIC_DRAW);
+        rock.setInstanceBuffer(instanceBuffer);
+        rock.releaseCpuCopies();
+    }
+
+    // see Model::setupVertexArrays(), for a belt made on an upload context
+    void setupVertexArrays()
+    {
+        rock.setupVertexArrays();
+    }
+
+    // draws every rock, shader has to be in use. belt is the world transform of the ring's centre, the ring lies in
+    // its xz plane.
+    void draw(Shader& shader, GLint modelLoc, const glm::mat4& belt, unsigned int level = 0)
+    {
+        if (instances.empty())
+            return;
+        shader.setMat4(modelLoc, belt);
+        rock.DrawInstanced(shader, (unsigned int)instances.size(), level);
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)instances.size();
+    }
+
+    // box around every rock in the belt's space, e.g. to cull the whole belt with Frustum::visible()
+    glm::vec3 boundsMin() const
+    {
+        return -extent;
+    }
+
+    glm::vec3 boundsMax() const
+    {
+        return extent;
+    }
+
+    // bytes of the instance buffer
+    size_t bytes() const
+    {
+        return instances.size() * sizeof(glm::mat4);
+    }
+
+    // triangles of one frame's draw
+    size_t triangles(unsigned int level = 0) const
+    {
+        return rock.triangles(level) * instances.size();
+    }
+
+private:
+    std::vector<glm::mat4> instances;   // the CPU copy of instanceBuffer
+    GLBuffer instanceBuffer;
+    glm::vec3 extent;   // half size of the box around the ring
+
+    // a random spot, size and tumble for every rock. scale turns the model's radius into 1, centre is moved onto
+    // the rock's position so it spins around itself.
+    static std::vector<glm::mat4> scatter(unsigned int count, float radius, float width, float scale, glm::vec3 centre)
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::mat4> instances(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            // evenly around the ring, pushed in or out and up or down a little
+            float angle = (float)i / count * glm::two_pi<float>() + unit(random) * 0.01f;
+            float distance = radius + (unit(random) - 0.5f) * width;
+            float height = (unit(random) - 0.5f) * width * 0.1f;
+            glm::vec3 position(std::sin(angle) * distance, height, std::cos(angle) * distance);
+
+            float size = (0.2f + 0.8f * unit(random) * unit(random)) * scale;
+            glm::vec3 axis(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+            if (glm::dot(axis, axis) < 1e-6f)
+                axis = glm::vec3(0.0f, 1.0f, 0.0f);
+
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, unit(random) * glm::two_pi<float>(), glm::normalize(axis));
+            model = glm::scale(model, glm::vec3(size));
+            instances[i] = glm::translate(model, -centre);
+        }
+        return instances;
+    }
+};
+#endif
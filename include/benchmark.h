@@ -0,0 +1,232 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Collects per-frame times of a fixed-timestep run of the timeline and reports frame-time percentiles per act.
+// Other subsystems can attach their own numbers with addStat(), they end up in the same JSON file.
+class Benchmark
+{
+public:
+    struct Act {
+        std::string name;
+        float start;            // runTime the act begins at, an act lasts until the next one starts
+        std::vector<double> frameTimes;
+    };
+
+    std::vector<Act> acts;
+    std::vector<double> frameTimes;
+    double step;
+
+    // step is the fixed timestep in seconds fed to runTime every frame
+    Benchmark(double step = 1.0 / 60.0) : step(step)
+    {
+        // the acts of the demo timeline in OpenGLdemo.cpp
+        acts.push_back({ "sunrise", 0.0f, {} });
+        acts.push_back({ "wild", 20.0f, {} });
+        acts.push_back({ "scene", 90.0f, {} });
+        acts.push_back({ "outro", 150.0f, {} });
+    }
+
+    void beginFrame()
+    {
+        frameStart = std::chrono::steady_clock::now();
+    }
+
+    // call after the frame is finished on the GPU, runTime decides which act the frame belongs to
+    void endFrame(float runTime)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        frameTimes.push_back(ms);
+        for (int i = (int)acts.size() - 1; i >= 0; i--)
+        {
+            if (runTime >= acts[i].start)
+            {
+                acts[i].frameTimes.push_back(ms);
+                break;
+            }
+        }
+    }
+
+    // extra numbers reported under "stats": { section: { key: value } }
+    void addStat(const std::string& section, const std::string& key, double value)
+    {
+        stats[section][key] = value;
+    }
+
+    // writes the results as JSON, keys ending in _ms are frame or pass times in milliseconds
+    bool writeJson(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK::COULD_NOT_WRITE " << path << std::endl;
+            return false;
+        }
+        file << std::fixed << std::setprecision(8);
+        file << "{\n";
+        file << "  \"step\": " << step << ",\n";
+        file << std::setprecision(4);
+        file << "  \"frames\": " << frameTimes.size() << ",\n";
+        file << "  \"overall\": ";
+        writeSummary(file, frameTimes);
+        file << ",\n  \"acts\": {\n";
+        for (unsigned int i = 0; i < acts.size(); i++)
+        {
+            file << "    \"" << acts[i].name << "\": ";
+            writeSummary(file, acts[i].frameTimes);
+            file << (i + 1 < acts.size() ? ",\n" : "\n");
+        }
+        file << "  },\n  \"stats\": {";
+        unsigned int s = 0;
+        for (const auto& section : stats)
+        {
+            file << (s++ ? ",\n" : "\n") << "    \"" << section.first << "\": {";
+            unsigned int k = 0;
+            for (const auto& value : section.second)
+                file << (k++ ? ", " : " ") << "\"" << value.first << "\": " << value.second;
+            file << " }";
+        }
+        file << (stats.empty() ? "}\n" : "\n  }\n");
+        file << "}\n";
+        return true;
+    }
+
+    // compares two result files and prints every timing that got slower than the threshold (in percent).
+    // only the frame-time percentiles of the whole run and of each act can fail the comparison, max is too noisy to
+    // gate on. the other *_ms stats (load times, GPU passes, ...) are listed too, but they depend on things like warm
+    // shader and mesh caches and never fail it.
+    // returns true when there are no regressions.
+    static bool compare(const std::string& currentPath, const std::string& baselinePath, double thresholdPercent)
+    {
+        std::map<std::string, double> current, baseline;
+        if (!readJson(currentPath, current) || !readJson(baselinePath, baseline))
+            return false;
+
+        bool ok = true;
+        std::cout << std::fixed << std::setprecision(3);
+        for (const auto& entry : current)
+        {
+            const std::string& key = entry.first;
+            if (!endsWith(key, "_ms") || endsWith(key, "max_ms"))
+                continue;
+            auto base = baseline.find(key);
+            if (base == baseline.end() || base->second <= 0.0)
+                continue;
+            double change = (entry.second - base->second) / base->second * 100.0;
+            bool gated = frameTime(key);
+            bool regressed = gated && change > thresholdPercent;
+            if (regressed)
+                ok = false;
+            std::cout << (regressed ? "REGRESSION " : (gated ? "           " : "      info ")) << key << ": "
+                << base->second << " ms -> " << entry.second << " ms ("
+                << (change >= 0.0 ? "+" : "") << change << "%)" << std::endl;
+        }
+        std::cout << (ok ? "no regressions" : "regressions found") << " against " << baselinePath
+            << " (threshold " << thresholdPercent << "%)" << std::endl;
+        return ok;
+    }
+
+private:
+    std::chrono::steady_clock::time_point frameStart;
+    std::map<std::string, std::map<std::string, double>> stats;
+
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        // nearest-rank
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    static void writeSummary(std::ostream& out, std::vector<double> times)
+    {
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double t : times)
+            sum += t;
+        out << "{ \"frames\": " << times.size()
+            << ", \"mean_ms\": " << (times.empty() ? 0.0 : sum / times.size())
+            << ", \"p50_ms\": " << percentile(times, 50.0)
+            << ", \"p95_ms\": " << percentile(times, 95.0)
+            << ", \"p99_ms\": " << percentile(times, 99.0)
+            << ", \"max_ms\": " << (times.empty() ? 0.0 : times.back()) << " }";
+    }
+
+    // the frame-time percentiles writeJson() puts under overall and acts
+    static bool frameTime(const std::string& key)
+    {
+        return key.compare(0, 8, "overall.") == 0 || key.compare(0, 5, "acts.") == 0;
+    }
+
+    static bool endsWith(const std::string& s, const std::string& suffix)
+    {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // reads the numbers of a result file into flat dotted keys, e.g. "acts.scene.p95_ms".
+    // only understands what writeJson produces: nested objects with numeric values.
+    static bool readJson(const std::string& path, std::map<std::string, double>& values)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK::COULD_NOT_READ " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        std::string text = stream.str();
+
+        std::vector<std::string> scope;
+        std::string key;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            char c = text[i];
+            if (c == '"')
+            {
+                size_t end = text.find('"', i + 1);
+                if (end == std::string::npos)
+                    break;
+                key = text.substr(i + 1, end - i - 1);
+                i = end;
+            }
+            else if (c == '{')
+            {
+                if (!key.empty())
+                    scope.push_back(key);
+                key.clear();
+            }
+            else if (c == '}')
+            {
+                if (!scope.empty())
+                    scope.pop_back();
+            }
+            else if (c == '-' || std::isdigit((unsigned char)c))
+            {
+                char* end;
+                double value = std::strtod(text.c_str() + i, &end);
+                std::string name;
+                for (const std::string& s : scope)
+                    name += s + ".";
+                values[name + key] = value;
+                i = end - text.c_str() - 1;
+                key.clear();
+            }
+        }
+        return true;
+    }
+};
+#endif
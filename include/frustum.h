@@ -0,0 +1,142 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// The six planes of the view volume, pulled out of projection * view (Gribb & Hartmann), normals pointing inwards.
+// Objects are tested with their object space bounds and the matrix placing them: the bounding sphere first, which
+// settles most of them, the box transformed into a world space box only for spheres crossing a plane. Both tests
+// are conservative, an object is only culled when it is completely outside one plane.
+// Every visible() call is counted, counters() holds the numbers since the frustum was made, so one Frustum per frame
+// gives the numbers of that frame.
+//
+//     Frustum frustum(projection * view);
+//     if (frustum.visible(model, mesh.boundsMin, mesh.boundsMax))
+//         draw();
+class Frustum
+{
+public:
+    enum Containment { OUTSIDE, INTERSECTING, INSIDE };
+
+    struct Counters {
+        unsigned int tested = 0;
+        unsigned int culled = 0;
+
+        unsigned int drawn() const
+        {
+            return tested - culled;
+        }
+    };
+
+    // off: everything is visible, the tests are still counted
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        // -w <= x, y, z <= w in clip space
+        planes[0] = rows[3] + rows[0];   // left
+        planes[1] = rows[3] - rows[0];   // right
+        planes[2] = rows[3] + rows[1];   // bottom
+        planes[3] = rows[3] - rows[1];   // top
+        planes[4] = rows[3] + rows[2];   // near
+        planes[5] = rows[3] - rows[2];   // far
+        for (glm::vec4& plane : planes)
+            plane /= std::max(glm::length(glm::vec3(plane)), 1e-12f);
+    }
+
+    // world space sphere
+    Containment sphere(const glm::vec3& centre, float radius) const
+    {
+        if (!enabled())
+            return INSIDE;
+        Containment result = INSIDE;
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+            if (distance < -radius)
+                return OUTSIDE;
+            if (distance < radius)
+                result = INTERSECTING;
+        }
+        return result;
+    }
+
+    // world space box given by its centre and half size, false if it is completely outside
+    bool box(const glm::vec3& centre, const glm::vec3& extent) const
+    {
+        if (!enabled())
+            return true;
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+            if (distance < -glm::dot(glm::abs(glm::vec3(plane)), extent))
+                return false;
+        }
+        return true;
+    }
+
+    // true unless the object space box, with its bounding sphere, placed by model is completely outside. counted.
+    bool visible(const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& centre, float radius) const
+    {
+        bool result = true;
+        Containment containment = sphere(glm::vec3(model * glm::vec4(centre, 1.0f)), radius * maxScale(model));
+        if (containment == OUTSIDE)
+            result = false;
+        else if (containment == INTERSECTING)
+        {
+            // the box in world space around the transformed box (Arvo)
+            glm::mat3 linear(model);
+            glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+            glm::vec3 worldCentre = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+            result = box(worldCentre, absolute * ((boundsMax - boundsMin) * 0.5f));
+        }
+        count(result);
+        return result;
+    }
+
+    // the same with the sphere around the box
+    bool visible(const glm::mat4& model, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+    {
+        return visible(model, boundsMin, boundsMax, (boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+    }
+
+    // counts a test made elsewhere, e.g. objects settled together by the sphere of their group
+    void count(bool visible, unsigned int objects = 1) const
+    {
+        counts.tested += objects;
+        if (!visible)
+            counts.culled += objects;
+    }
+
+    const Counters& counters() const
+    {
+        return counts;
+    }
+
+    // the largest factor model stretches a length by, scales a bounding sphere's radius. exact for rotations and
+    // scales, sheared matrices get the Frobenius norm, which is never smaller
+    static float maxScale(const glm::mat4& model)
+    {
+        glm::vec3 x(model[0]), y(model[1]), z(model[2]);
+        float xx = glm::dot(x, x), yy = glm::dot(y, y), zz = glm::dot(z, z);
+        float skew = std::abs(glm::dot(x, y)) + std::abs(glm::dot(y, z)) + std::abs(glm::dot(z, x));
+        if (skew <= 1e-4f * (xx + yy + zz))
+            return std::sqrt(std::max(xx, std::max(yy, zz)));
+        return std::sqrt(xx + yy + zz);
+    }
+
+private:
+    glm::vec4 planes[6];
+    mutable Counters counts;
+};
+#endif
@@ -0,0 +1,284 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <glad/glad.h>
+
+#include <mesh.h>
+#include <globject.h>
+#include <glstate.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Static geometry of many meshes packed into one vertex and one index buffer behind a single VAO.
+// Every drawn level of a mesh becomes a draw command (index count, first index, base vertex), so its indices stay
+// relative to its own vertices and a run of commands can be drawn without rebinding anything. With GL 4.3 /
+// ARB_multi_draw_indirect a run goes out as one glMultiDrawElementsIndirect from a GL_DRAW_INDIRECT_BUFFER, otherwise
+// as one glDrawElementsBaseVertex per command.
+//
+// The meshes added through Model::addTo() free their own buffers, the arena holds the only copy of their geometry.
+//
+//     GeometryArena arena(VERTEX_FLOAT);
+//     model.addTo(arena);      // add() every mesh and addDraw() its levels, Model::Draw() then draws from the arena
+//     arena.build();           // uploads, nothing can be added afterwards
+class GeometryArena
+{
+public:
+    // the layout glMultiDrawElementsIndirect reads
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    explicit GeometryArena(VertexFormat format) : format(format) {}
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // off: always draw command by command, e.g. to compare against the multi-draw path
+    static bool& multiDrawEnabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    // the entry point is only loaded by glad when the context has GL 4.3
+    static bool multiDrawSupported()
+    {
+        return glMultiDrawElementsIndirect != nullptr;
+    }
+
+    // copies mesh's vertices and the indices of all its levels into the arena and returns its slot for addDraw(),
+    // -1 if the mesh wasn't added. the mesh has to be in the arena's format and keep its CPU copies until then.
+    int add(const Mesh& mesh)
+    {
+        if (built)
+        {
+            std::cout << "ERROR::GEOMETRYARENA::ADD_AFTER_BUILD" << std::endl;
+            return -1;
+        }
+        if (mesh.format != format)
+        {
+            std::cout << "ERROR::GEOMETRYARENA::FORMAT_MISMATCH" << std::endl;
+            return -1;
+        }
+        if (!mesh.hasCpuCopies())
+        {
+            std::cout << "ERROR::GEOMETRYARENA::MESH_WITHOUT_CPU_COPY" << std::endl;
+            return -1;
+        }
+        slots.push_back({ (GLuint)indices.size(), (GLint)vertexCount, mesh.lods });
+
+        const char* data = (const char*)mesh.vertexData();
+        vertices.insert(vertices.end(), data, data + mesh.vertexBytes());
+        mesh.appendIndices(indices);
+        vertexCount += mesh.vertexCount();
+        largestMesh = std::max(largestMesh, mesh.vertexCount());
+        return (int)slots.size() - 1;
+    }
+
+    // appends the command drawing a level of the mesh in slot and returns its index, the commands of a
+    // multi-draw have to be consecutive
+    unsigned int addDraw(unsigned int slot, unsigned int level)
+    {
+        if (built || slot >= slots.size())
+        {
+            std::cout << "ERROR::GEOMETRYARENA::BAD_DRAW" << std::endl;
+            return 0;
+        }
+        const Slot& mesh = slots[slot];
+        const MeshLod& lod = mesh.lods[std::min((size_t)level, mesh.lods.size() - 1)];
+        DrawCommand command;
+        command.count = lod.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = mesh.firstIndex + lod.firstIndex;
+        command.baseVertex = mesh.baseVertex;
+        command.baseInstance = 0;
+        commands.push_back(command);
+        return (unsigned int)commands.size() - 1;
+    }
+
+    // adds a tightly packed position stream for drawDepth(), like Mesh::enablePositionStream(). has to come before
+    // build()
+    void enablePositionStream()
+    {
+        if (built)
+        {
+            std::cout << "ERROR::GEOMETRYARENA::POSITION_STREAM_AFTER_BUILD" << std::endl;
+            return;
+        }
+        positionStream = true;
+    }
+
+    // uploads everything added so far and drops the CPU copies
+    void build()
+    {
+        if (built)
+            return;
+        PROFILE_ZONE("GeometryArena::build");
+        built = true;
+        // indices are relative to each mesh's base vertex, so they only have to fit the largest mesh
+        indexType = largestMesh < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+
+        // filled through the copy target like Mesh does, the vertex array comes last
+        VBO = GLBuffer::create();
+        EBO = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_COPY_WRITE_BUFFER, shortIndices.size() * indexSize, shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * indexSize, indices.data(), GL_STATIC_DRAW);
+        if (positionStream)
+        {
+            // the position is the first member of both vertex layouts
+            size_t stride = format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+            std::vector<glm::vec3> positions(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++)
+                std::memcpy(&positions[i], &vertices[i * stride], sizeof(glm::vec3));
+            positionVBO = GLBuffer::create();
+            glBindBuffer(GL_COPY_WRITE_BUFFER, positionVBO);
+            glBufferData(GL_COPY_WRITE_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+            positionBytes = positions.size() * sizeof(glm::vec3);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        if (multiDrawSupported())
+        {
+            indirectBuffer = GLBuffer::create();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        vertexBytes = vertices.size();
+        indexBytes = indices.size() * indexSize;
+        std::vector<char>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+
+        if (!GLState::current().uploadOnly())
+            setupVertexArray();
+    }
+
+    // the VAOs over the built buffers. build() makes them unless it ran on an upload context (see
+    // GLState::uploadOnly()), the rendering context then has to call this before the first draw.
+    void setupVertexArray()
+    {
+        if (!built || VAO)
+            return;
+        VAO = GLVertexArray::create();
+        GLState::current().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        Mesh::setupAttributes(format);
+        if (positionVBO)
+        {
+            depthVAO = GLVertexArray::create();
+            GLState::current().bindVertexArray(depthVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        }
+        GLState::current().bindVertexArray(0);
+    }
+
+    bool isBuilt() const
+    {
+        return built;
+    }
+
+    // draws commands [first, first + count), the shader and textures have to be set up
+    void draw(unsigned int first, unsigned int count)
+    {
+        submit(VAO, first, count);
+    }
+
+    // draws only the positions of commands [first, first + count) for depth-only passes, from the position stream
+    // if there is one
+    void drawDepth(unsigned int first, unsigned int count)
+    {
+        submit(depthVAO ? depthVAO : VAO, first, count);
+    }
+
+    // draw calls issued since the last call, one per multi-draw or per command in the fallback
+    unsigned int takeSubmissions()
+    {
+        unsigned int count = submissions;
+        submissions = 0;
+        return count;
+    }
+
+    unsigned int commandCount() const
+    {
+        return (unsigned int)commands.size();
+    }
+
+    // bytes on the GPU once built
+    size_t bytes() const
+    {
+        return vertexBytes + indexBytes + positionBytes + (indirectBuffer ? commands.size() * sizeof(DrawCommand) : 0);
+    }
+
+private:
+    // where a mesh's data went
+    struct Slot {
+        GLuint firstIndex;
+        GLint baseVertex;
+        std::vector<MeshLod> lods;
+    };
+
+    VertexFormat format;
+    std::vector<Slot> slots;
+    std::vector<char> vertices;         // until build()
+    std::vector<unsigned int> indices;  // until build()
+    std::vector<DrawCommand> commands;
+    size_t vertexCount = 0;
+    size_t largestMesh = 0;
+    bool positionStream = false;
+    bool built = false;
+
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexSize = sizeof(unsigned int);
+    GLVertexArray VAO;
+    GLVertexArray depthVAO;   // positions only, see enablePositionStream()
+    GLBuffer VBO, EBO;
+    GLBuffer positionVBO;
+    GLBuffer indirectBuffer;
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+    size_t positionBytes = 0;
+    unsigned int submissions = 0;
+
+    void submit(GLuint vertexArray, unsigned int first, unsigned int count)
+    {
+        if (!built || count == 0)
+            return;
+        GLState::current().bindVertexArray(vertexArray);
+        if (multiDrawEnabled() && indirectBuffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)(first * sizeof(DrawCommand)), (GLsizei)count, 0);
+            submissions++;
+            return;
+        }
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            const DrawCommand& command = commands[i];
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.count, indexType, (void*)((size_t)command.firstIndex * indexSize), command.baseVertex);
+            submissions++;
+        }
+    }
+};
+#endif
@@ -0,0 +1,130 @@
+#ifndef GLOBJECT_H
+#define GLOBJECT_H
+
+#include <glad/glad.h>
+
+#include <glstate.h>
+
+enum GLObjectType { GL_OBJECT_BUFFER, GL_OBJECT_VERTEX_ARRAY, GL_OBJECT_TEXTURE, GL_OBJECT_SHADER, GL_OBJECT_PROGRAM,
+    GL_OBJECT_FRAMEBUFFER, GL_OBJECT_RENDERBUFFER };
+
+// Owner of one GL object name, deletes it when it goes away. It can be moved but not copied, so exactly one
+// owner frees every object. It converts to the name, code that only uses the object takes a plain GLuint.
+// Deleted programs, vertex arrays and textures are reported to GLState, GL hands their names out again.
+// The context has to outlive every owner.
+//
+//     GLBuffer buffer = GLBuffer::create();
+//     glBindBuffer(GL_ARRAY_BUFFER, buffer);
+template <GLObjectType Type>
+class GLObject
+{
+public:
+    GLObject() {}
+    explicit GLObject(GLuint id) : id(id) {}
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    GLObject(GLObject&& other) noexcept : id(other.release())
+    {
+    }
+
+    GLObject& operator=(GLObject&& other) noexcept
+    {
+        if (this != &other)
+            reset(other.release());
+        return *this;
+    }
+
+    ~GLObject()
+    {
+        reset();
+    }
+
+    // a new object, shaders and programs are made with glCreateShader / glCreateProgram and adopted with reset()
+    static GLObject create()
+    {
+        GLuint name = 0;
+        if (Type == GL_OBJECT_BUFFER)
+            glGenBuffers(1, &name);
+        else if (Type == GL_OBJECT_VERTEX_ARRAY)
+            glGenVertexArrays(1, &name);
+        else if (Type == GL_OBJECT_TEXTURE)
+            glGenTextures(1, &name);
+        else if (Type == GL_OBJECT_PROGRAM)
+            name = glCreateProgram();
+        else if (Type == GL_OBJECT_FRAMEBUFFER)
+            glGenFramebuffers(1, &name);
+        else if (Type == GL_OBJECT_RENDERBUFFER)
+            glGenRenderbuffers(1, &name);
+        return GLObject(name);
+    }
+
+    operator GLuint() const
+    {
+        return id;
+    }
+
+    GLuint get() const
+    {
+        return id;
+    }
+
+    // gives the object up without deleting it
+    GLuint release()
+    {
+        GLuint name = id;
+        id = 0;
+        return name;
+    }
+
+    // deletes the object and takes over name, 0 leaves it empty
+    void reset(GLuint name = 0)
+    {
+        if (id && id != name)
+            destroy(id);
+        id = name;
+    }
+
+private:
+    GLuint id = 0;
+
+    static void destroy(GLuint name)
+    {
+        switch (Type)
+        {
+        case GL_OBJECT_BUFFER:
+            glDeleteBuffers(1, &name);
+            break;
+        case GL_OBJECT_VERTEX_ARRAY:
+            GLState::current().vertexArrayDeleted(name);
+            glDeleteVertexArrays(1, &name);
+            break;
+        case GL_OBJECT_TEXTURE:
+            GLState::current().textureDeleted(name);
+            glDeleteTextures(1, &name);
+            break;
+        case GL_OBJECT_SHADER:
+            glDeleteShader(name);
+            break;
+        case GL_OBJECT_PROGRAM:
+            GLState::current().programDeleted(name);
+            glDeleteProgram(name);
+            break;
+        case GL_OBJECT_FRAMEBUFFER:
+            glDeleteFramebuffers(1, &name);
+            break;
+        case GL_OBJECT_RENDERBUFFER:
+            glDeleteRenderbuffers(1, &name);
+            break;
+        }
+    }
+};
+
+typedef GLObject<GL_OBJECT_BUFFER> GLBuffer;
+typedef GLObject<GL_OBJECT_VERTEX_ARRAY> GLVertexArray;
+typedef GLObject<GL_OBJECT_TEXTURE> GLTexture;
+typedef GLObject<GL_OBJECT_SHADER> GLShader;
+typedef GLObject<GL_OBJECT_PROGRAM> GLProgram;
+typedef GLObject<GL_OBJECT_FRAMEBUFFER> GLFramebuffer;
+typedef GLObject<GL_OBJECT_RENDERBUFFER> GLRenderbuffer;
+#endif
@@ -0,0 +1,243 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <string>
+
+// Shadow copy of the GL binding state that drops calls which would not change anything.
+// Tracks the bound program, vertex array, active texture unit, the 2D / cube map texture of every unit,
+// the depth function and the polygon mode. Everything that touches this state has to go through it,
+// after foreign code changed GL state directly call invalidate(), the next call of every kind is then issued.
+// Deleted objects have to be reported with the *Deleted() calls, GL may hand out their names again.
+//
+// State belongs to a context, current() is the state of the context current on the calling thread: every thread
+// with a context of its own, like the asset loader's upload context (see assetloader.h), has a separate copy.
+class GLState
+{
+public:
+    enum Call { PROGRAM, VERTEX_ARRAY, ACTIVE_TEXTURE, TEXTURE, DEPTH_FUNC, POLYGON_MODE, CALL_KINDS };
+
+    static const unsigned int MAX_TEXTURE_UNITS = 32;   // units above are passed through untracked
+
+    struct Counters {
+        unsigned int issued[CALL_KINDS] = {};
+        unsigned int elided[CALL_KINDS] = {};
+
+        unsigned int totalIssued() const
+        {
+            unsigned int sum = 0;
+            for (unsigned int i = 0; i < CALL_KINDS; i++)
+                sum += issued[i];
+            return sum;
+        }
+
+        unsigned int totalElided() const
+        {
+            unsigned int sum = 0;
+            for (unsigned int i = 0; i < CALL_KINDS; i++)
+                sum += elided[i];
+            return sum;
+        }
+    };
+
+    static GLState& current()
+    {
+        static thread_local GLState state;
+        return state;
+    }
+
+    // set on a context that only creates objects for another one in its share group. vertex arrays aren't shared
+    // between contexts, meshes and arenas made on it leave theirs to setupVertexArray() on the rendering context.
+    void setUploadOnly(bool on)
+    {
+        upload = on;
+    }
+
+    bool uploadOnly() const
+    {
+        return upload;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (track(PROGRAM, program, id))
+            glUseProgram(id);
+    }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (track(VERTEX_ARRAY, vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    // unit is the index, not GL_TEXTUREi
+    void activeTexture(unsigned int unit)
+    {
+        if (track(ACTIVE_TEXTURE, activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds texture to target on unit, switching the active unit only when the binding really changes
+    void bindTexture(unsigned int unit, GLenum target, GLuint id)
+    {
+        GLuint* slot = textureSlot(unit, target);
+        if (slot && *slot == id)
+        {
+            frame.elided[TEXTURE]++;
+            return;
+        }
+        activeTexture(unit);
+        frame.issued[TEXTURE]++;
+        glBindTexture(target, id);
+        if (slot)
+            *slot = id;
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (track(DEPTH_FUNC, depth, func))
+            glDepthFunc(func);
+    }
+
+    // only GL_FRONT_AND_BACK exists in the core profile
+    void polygonMode(GLenum mode)
+    {
+        if (track(POLYGON_MODE, polygon, mode))
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+
+    void programDeleted(GLuint id)
+    {
+        if (program == id)
+            program = 0;
+    }
+
+    void vertexArrayDeleted(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = 0;
+    }
+
+    void textureDeleted(GLuint id)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+        {
+            for (GLuint& bound : textures[unit])
+            {
+                if (bound == id)
+                    bound = 0;
+            }
+        }
+    }
+
+    // forget everything, the next call of every kind reaches GL
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        depth = UNKNOWN;
+        polygon = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures[unit][0] = textures[unit][1] = UNKNOWN;
+    }
+
+    // closes the counters of the frame, lastFrame() reports them until the next call
+    void endFrame()
+    {
+        previous = frame;
+        for (unsigned int i = 0; i < CALL_KINDS; i++)
+        {
+            total.issued[i] += frame.issued[i];
+            total.elided[i] += frame.elided[i];
+        }
+        frame = Counters();
+        frames++;
+    }
+
+    // drops everything counted so far, e.g. the calls made while loading
+    void resetCounters()
+    {
+        frame = previous = total = Counters();
+        frames = 0;
+    }
+
+    const Counters& lastFrame() const
+    {
+        return previous;
+    }
+
+    // sums over every frame closed by endFrame()
+    const Counters& totals() const
+    {
+        return total;
+    }
+
+    unsigned int frameCount() const
+    {
+        return frames;
+    }
+
+    static const char* callName(unsigned int call)
+    {
+        static const char* names[CALL_KINDS] = { "program", "vertex_array", "active_texture", "texture", "depth_func", "polygon_mode" };
+        return names[call];
+    }
+
+    // e.g. "gl 12 issued 30 elided" for the last frame
+    std::string readout() const
+    {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "gl %u issued %u elided", previous.totalIssued(), previous.totalElided());
+        return buffer;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint depth;
+    GLuint polygon;
+    GLuint textures[MAX_TEXTURE_UNITS][2];   // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+
+    Counters frame;
+    Counters previous;
+    Counters total;
+    unsigned int frames = 0;
+    bool upload = false;
+
+    // nothing is known about a fresh context's state until the first call of each kind
+    GLState()
+    {
+        invalidate();
+    }
+
+    // true when the call has to be issued
+    bool track(Call call, GLuint& shadow, GLuint value)
+    {
+        if (shadow == value)
+        {
+            frame.elided[call]++;
+            return false;
+        }
+        shadow = value;
+        frame.issued[call]++;
+        return true;
+    }
+
+    GLuint* textureSlot(unsigned int unit, GLenum target)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &textures[unit][0];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &textures[unit][1];
+        return nullptr;
+    }
+};
+#endif
@@ -0,0 +1,140 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Measures GPU time of render passes with GL_TIME_ELAPSED queries.
+// Every pass has one query per frame in flight; results are read back FRAMES_IN_FLIGHT frames later,
+// by then the GPU is done with them so reading never stalls the pipeline.
+class GpuTimer
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 4;
+    static const unsigned int WINDOW = 60;   // samples in the rolling average
+
+    std::vector<std::string> names;
+
+    GpuTimer(const std::vector<std::string>& passNames) : names(passNames)
+    {
+        passes.resize(names.size());
+    }
+
+    // needs a current context
+    void init()
+    {
+        for (unsigned int i = 0; i < passes.size(); i++)
+            glGenQueries(FRAMES_IN_FLIGHT, passes[i].queries);
+    }
+
+    // deletes the queries, needs the context init() ran with. nothing happens without init()
+    void release()
+    {
+        for (Pass& pass : passes)
+        {
+            if (pass.queries[0])
+                glDeleteQueries(FRAMES_IN_FLIGHT, pass.queries);
+            for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+            {
+                pass.queries[i] = 0;
+                pass.issued[i] = false;
+            }
+        }
+    }
+
+    // picks the query slot for this frame and collects the results from the frame that used it last
+    void beginFrame()
+    {
+        slot = frame % FRAMES_IN_FLIGHT;
+        frame++;
+        for (unsigned int i = 0; i < passes.size(); i++)
+        {
+            Pass& pass = passes[i];
+            if (!pass.issued[slot])
+                continue;
+            pass.issued[slot] = false;
+            GLint available = 0;
+            glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            // still not done after FRAMES_IN_FLIGHT frames: drop the sample rather than wait for it
+            if (!available)
+                continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &ns);
+            pass.addSample(ns / 1000000.0);
+        }
+    }
+
+    // passes can't nest, GL allows only one active GL_TIME_ELAPSED query
+    void begin(unsigned int pass)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, passes[pass].queries[slot]);
+    }
+
+    void end(unsigned int pass)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        passes[pass].issued[slot] = true;
+    }
+
+    // rolling average over the last WINDOW samples in milliseconds
+    double average(unsigned int pass) const
+    {
+        const Pass& p = passes[pass];
+        unsigned int count = p.count < WINDOW ? p.count : WINDOW;
+        if (count == 0)
+            return 0.0;
+        double sum = 0.0;
+        for (unsigned int i = 0; i < count; i++)
+            sum += p.window[i];
+        return sum / count;
+    }
+
+    // average over every sample since init in milliseconds
+    double mean(unsigned int pass) const
+    {
+        const Pass& p = passes[pass];
+        return p.count ? p.total / p.count : 0.0;
+    }
+
+    unsigned int samples(unsigned int pass) const
+    {
+        return passes[pass].count;
+    }
+
+    // one line summary of the rolling averages, e.g. "scene 0.41 ms  planet 1.20 ms"
+    std::string readout() const
+    {
+        std::string text;
+        char buffer[64];
+        for (unsigned int i = 0; i < passes.size(); i++)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%s%s %.2f ms", i ? "  " : "", names[i].c_str(), average(i));
+            text += buffer;
+        }
+        return text;
+    }
+
+private:
+    struct Pass {
+        GLuint queries[FRAMES_IN_FLIGHT] = {};
+        bool issued[FRAMES_IN_FLIGHT] = {};
+        double window[WINDOW] = {};
+        double total = 0.0;
+        unsigned int count = 0;
+
+        void addSample(double ms)
+        {
+            window[count % WINDOW] = ms;
+            total += ms;
+            count++;
+        }
+    };
+
+    std::vector<Pass> passes;
+    unsigned int frame = 0;
+    unsigned int slot = 0;
+};
+#endif
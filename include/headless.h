@@ -0,0 +1,167 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Surfaceless EGL context used by --headless runs on display-less render nodes (Mesa llvmpipe works fine).
+// Only available when the build defines DEMO_HEADLESS (the Linux CMake target does so when EGL is found).
+#ifdef DEMO_HEADLESS
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+class HeadlessContext
+{
+public:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    // creates a core profile context of the given version without any window or pbuffer surface.
+    // everything is rendered into application owned framebuffers.
+    // ------------------------------------------------------------------------
+    bool create(int major, int minor)
+    {
+        display = getDisplay();
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED" << std::endl;
+            return false;
+        }
+
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_KHR_surfaceless_context not supported" << std::endl;
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_BIND_API_FAILED" << std::endl;
+            return false;
+        }
+
+        // the default surface type is EGL_WINDOW_BIT which surfaceless displays don't offer
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "ERROR::HEADLESS::NO_SUITABLE_EGL_CONFIG" << std::endl;
+            return false;
+        }
+
+        context = createContext(EGL_NO_CONTEXT, major, minor);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CREATE_CONTEXT_FAILED" << std::endl;
+            return false;
+        }
+
+        if (!makeCurrent())
+        {
+            std::cout << "ERROR::HEADLESS::EGL_MAKE_CURRENT_FAILED" << std::endl;
+            return false;
+        }
+
+        start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    // a second context in the share group of owner, on owner's display, e.g. for the asset loader's thread (see
+    // assetloader.h). it isn't made current here, the thread using it calls makeCurrent() itself.
+    bool createShared(const HeadlessContext& owner, int major, int minor)
+    {
+        display = owner.display;
+        config = owner.config;
+        start = owner.start;
+        sharesDisplay = true;
+        context = createContext(owner.context, major, minor);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CREATE_SHARED_CONTEXT_FAILED" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // makes the context current on the calling thread
+    bool makeCurrent()
+    {
+        return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+    }
+
+    // leaves the calling thread without a context
+    void release()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    // a shared context only goes away itself, the display stays with its owner
+    void destroy()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        if (!sharesDisplay)
+            release();
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        if (!sharesDisplay)
+            eglTerminate(display);
+        context = EGL_NO_CONTEXT;
+        display = EGL_NO_DISPLAY;
+    }
+
+    // seconds since the context was created, the headless stand-in for glfwGetTime()
+    double getTime() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // loader handed to glad
+    static void* getProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+private:
+    EGLConfig config = nullptr;
+    bool sharesDisplay = false;
+    std::chrono::steady_clock::time_point start;
+
+    // core profile context of the given version sharing objects with share, which may be EGL_NO_CONTEXT
+    EGLContext createContext(EGLContext share, int major, int minor)
+    {
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        return eglCreateContext(display, config, share, contextAttribs);
+    }
+
+    // prefer the Mesa surfaceless platform so no X11/Wayland/GBM device is required
+    EGLDisplay getDisplay()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        {
+            EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (surfaceless != EGL_NO_DISPLAY)
+                return surfaceless;
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+};
+
+#endif
+#endif
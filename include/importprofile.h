@@ -0,0 +1,209 @@
+#ifndef IMPORTPROFILE_H
+#define IMPORTPROFILE_H
+
+#include <assimp/DefaultLogger.hpp>
+#include <assimp/LogStream.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/postprocess.h>
+
+#include <profiler.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Assimp post-processing presets a model can be imported with:
+//     fast-load      the minimum the renderer needs, triangles, flipped UVs, tangents and normals where missing
+//     render-optimal fast-load plus welding identical vertices, merging meshes and materials and cache ordering,
+//                    slower to import but the cooked copy (see meshcache.h) makes that a one time cost
+//     debug          fast-load plus validation of the scene, Assimp's log is echoed to stdout
+enum ImportProfile { IMPORT_FAST_LOAD, IMPORT_RENDER_OPTIMAL, IMPORT_DEBUG, IMPORT_PROFILE_COUNT };
+
+inline const char* importProfileName(ImportProfile profile)
+{
+    static const char* names[IMPORT_PROFILE_COUNT] = { "fast-load", "render-optimal", "debug" };
+    return names[profile];
+}
+
+// parses a name printed by importProfileName()
+inline bool importProfileFromName(const char* name, ImportProfile& profile)
+{
+    for (int i = 0; i < IMPORT_PROFILE_COUNT; i++)
+    {
+        if (std::strcmp(name, importProfileName((ImportProfile)i)) == 0)
+        {
+            profile = (ImportProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline unsigned int importFlags(ImportProfile profile)
+{
+    // skinned meshes get at most the 4 bones a VertexBones holds
+    unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals
+        | aiProcess_LimitBoneWeights;
+    if (profile == IMPORT_RENDER_OPTIMAL)
+        flags |= aiProcess_JoinIdenticalVertices | aiProcess_OptimizeMeshes | aiProcess_RemoveRedundantMaterials | aiProcess_ImproveCacheLocality;
+    else if (profile == IMPORT_DEBUG)
+        flags |= aiProcess_ValidateDataStructure | aiProcess_FindInvalidData;
+    return flags;
+}
+
+// what one model load did, filled in by Model and ImportMonitor
+struct ImportStats {
+    struct Step {
+        std::string name;
+        double ms;
+    };
+
+    ImportProfile profile = IMPORT_RENDER_OPTIMAL;
+    bool cooked = false;            // came from the mesh cache, Assimp didn't run
+    unsigned int meshes = 0;
+    size_t vertices = 0;            // as uploaded
+    size_t indices = 0;
+    long long verticesRead = -1;    // before aiProcess_JoinIdenticalVertices, -1 when it didn't run
+    unsigned int missingTangents = 0; // meshes that got a generated tangent frame
+    std::vector<Step> steps;        // Assimp's file read and post-processing steps, then ours
+
+    long long duplicatesRemoved() const
+    {
+        return verticesRead < 0 ? 0 : verticesRead - (long long)vertices;
+    }
+
+    double totalMs() const
+    {
+        double sum = 0.0;
+        for (const Step& step : steps)
+            sum += step.ms;
+        return sum;
+    }
+
+    void addStep(const std::string& name, double ms)
+    {
+        steps.push_back({ name, ms });
+    }
+
+    void print(const std::string& path) const
+    {
+        std::ostringstream report;
+        report << "import: " << path << " (" << (cooked ? "mesh cache" : importProfileName(profile)) << ") " << meshes << " meshes, "
+            << vertices << " vertices, " << indices << " indices";
+        if (verticesRead >= 0)
+            report << ", " << duplicatesRemoved() << " duplicate vertices removed";
+        if (missingTangents)
+            report << ", " << missingTangents << " meshes without tangents";
+        report << ", " << totalMs() << " ms\n";
+        for (const Step& step : steps)
+            report << "    " << step.name << " " << step.ms << " ms\n";
+        std::cout << report.str() << std::flush;
+    }
+};
+
+// Times an Assimp import through its progress callbacks and names the post-processing steps from its log.
+// The callbacks mark the end of the file read and the start of every step; Assimp logs "<Name>Process begin"
+// when a step runs, and JoinVerticesProcess logs the vertex count before and after welding.
+// Assimp's logger is global, imports watched by a monitor must not overlap.
+class ImportMonitor : public Assimp::ProgressHandler
+{
+public:
+    ImportMonitor(ImportStats& stats, bool echo) : stats(stats), stream(new Stream(*this, echo))
+    {
+        ownsLogger = Assimp::DefaultLogger::isNullLogger();
+        if (ownsLogger)
+            Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE, 0);
+        Assimp::DefaultLogger::get()->attachStream(stream, SEVERITY);
+        last = Profiler::now();
+    }
+
+    ~ImportMonitor()
+    {
+        // detached streams stay ours, killing the logger would delete attached ones
+        Assimp::DefaultLogger::get()->detatchStream(stream, SEVERITY);
+        delete stream;
+        if (ownsLogger)
+            Assimp::DefaultLogger::kill();
+    }
+
+    bool Update(float /*percentage*/) override
+    {
+        return true;
+    }
+
+    void UpdateFileRead(int currentStep, int numberOfSteps) override
+    {
+        if (currentStep == 0)
+            last = Profiler::now();
+        else if (currentStep >= numberOfSteps)
+            close("read file");
+    }
+
+    // called before step currentStep and once more with currentStep == numberOfSteps after the last one
+    void UpdatePostProcess(int currentStep, int numberOfSteps) override
+    {
+        if (inStep)
+            close(stepName.empty() ? "post-process step " + std::to_string(currentStep - 1) : stepName);
+        else
+            close("preprocess");
+        stepName.clear();
+        inStep = currentStep < numberOfSteps;
+        last = Profiler::now();
+    }
+
+private:
+    static const unsigned int SEVERITY = Assimp::Logger::Debugging | Assimp::Logger::Info | Assimp::Logger::Warn | Assimp::Logger::Err;
+
+    class Stream : public Assimp::LogStream
+    {
+    public:
+        Stream(ImportMonitor& monitor, bool echo) : monitor(monitor), echo(echo) {}
+
+        void write(const char* message) override
+        {
+            if (echo)
+                std::cout << "assimp: " << message << std::flush;
+            monitor.message(message);
+        }
+
+    private:
+        ImportMonitor& monitor;
+        bool echo;
+    };
+
+    ImportStats& stats;
+    Stream* stream;
+    bool ownsLogger;
+    bool inStep = false;
+    std::string stepName;
+    int64_t last;
+
+    // steps that did nothing measurable are dropped, Assimp reports every step whether it is enabled or not
+    void close(const std::string& name)
+    {
+        int64_t now = Profiler::now();
+        double ms = (now - last) / 1e6;
+        if (ms >= 0.01)
+            stats.addStep(name, ms);
+        last = now;
+    }
+
+    void message(const char* text)
+    {
+        const char* begin = std::strstr(text, "Process begin");
+        if (begin && inStep)
+        {
+            const char* name = begin;
+            while (name > text && name[-1] != ' ')
+                name--;
+            stepName.assign(name, begin);
+        }
+        const char* joined = std::strstr(text, "JoinVerticesProcess finished | Verts in: ");
+        if (joined)
+            stats.verticesRead = std::atoll(joined + std::strlen("JoinVerticesProcess finished | Verts in: "));
+    }
+};
+#endif
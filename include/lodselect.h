@@ -0,0 +1,97 @@
+#ifndef LODSELECT_H
+#define LODSELECT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+enum LodTransition { LOD_HARD, LOD_DITHER };
+
+// Picks a level of detail for one drawn object from the screen space size of each level's simplification error.
+// The coarsest level whose error projects to at most pixelError() pixels is used; a level is only left for a
+// coarser one once that one is comfortably below the limit, so an object at the boundary doesn't flip every frame.
+// With LOD_DITHER a change fades over fadeSeconds(): both levels are drawn with complementary screen-door
+// patterns (shaders/common/dither.glsl), fade() is the share of the old level.
+class LodSelector
+{
+public:
+    // off: level 0 always
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    static float& pixelError()
+    {
+        static float pixels = 1.0f;
+        return pixels;
+    }
+
+    static LodTransition& transition()
+    {
+        static LodTransition mode = LOD_DITHER;
+        return mode;
+    }
+
+    static float& fadeSeconds()
+    {
+        static float seconds = 0.25f;
+        return seconds;
+    }
+
+    // pixels an object space error covers at distance from the camera. fovy is in degrees, viewportHeight in pixels.
+    static float projectedError(float error, float scale, float distance, float fovy, float viewportHeight)
+    {
+        if (distance <= 0.0f)
+            return error > 0.0f ? viewportHeight : 0.0f;
+        return error * scale / distance * viewportHeight / (2.0f * std::tan(glm::radians(fovy) * 0.5f));
+    }
+
+    unsigned int level = 0;          // the level being drawn, or faded in
+    unsigned int previousLevel = 0;  // the level being faded out
+    float progress = 1.0f;
+
+    bool fading() const
+    {
+        return progress < 1.0f && previousLevel != level;
+    }
+
+    // share of previousLevel's pattern still drawn while fading
+    float fade() const
+    {
+        return 1.0f - progress;
+    }
+
+    // errors holds the object space error of every level, scale the object to world scale and distance the
+    // world space distance from the camera to the object's bounding sphere
+    void update(const std::vector<float>& errors, float scale, float distance, float fovy, float viewportHeight, float dt)
+    {
+        if (fading())
+            progress = std::min(1.0f, progress + (fadeSeconds() > 0.0f ? dt / fadeSeconds() : 1.0f));
+        unsigned int target = level;
+        if (!enabled() || errors.empty())
+            target = 0;
+        else
+        {
+            float limit = pixelError();
+            target = std::min(target, (unsigned int)errors.size() - 1);
+            while (target > 0 && projectedError(errors[target], scale, distance, fovy, viewportHeight) > limit)
+                target--;
+            if (target == level)
+            {
+                while (target + 1 < errors.size() && projectedError(errors[target + 1], scale, distance, fovy, viewportHeight) < limit * 0.8f)
+                    target++;
+            }
+        }
+        if (target == level)
+            return;
+        // a change during a fade starts from what is drawn the most at that moment
+        previousLevel = fading() && progress < 0.5f ? previousLevel : level;
+        level = target;
+        progress = transition() == LOD_DITHER ? 0.0f : 1.0f;
+    }
+};
+#endif
@@ -0,0 +1,90 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <cstddef>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+// glad defines APIENTRY without checking for windows.h, which defines the same __stdcall
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Resident memory of the process: what it holds in RAM now and the most it ever held.
+// Linux reads VmRSS and VmHWM from /proc/self/status, windows the working set, macOS the task info.
+// Both are 0 where the numbers can't be read.
+struct MemoryUsage {
+    size_t resident = 0;
+    size_t peak = 0;
+
+    static MemoryUsage current()
+    {
+        MemoryUsage usage;
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            usage.resident = counters.WorkingSetSize;
+            usage.peak = counters.PeakWorkingSetSize;
+        }
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+            usage.resident = info.resident_size;
+        struct rusage rusage;
+        if (getrusage(RUSAGE_SELF, &rusage) == 0)
+            usage.peak = (size_t)rusage.ru_maxrss;   // bytes on macOS
+#else
+        FILE* status = std::fopen("/proc/self/status", "r");
+        if (!status)
+            return usage;
+        char line[256];
+        while (std::fgets(line, sizeof(line), status))
+        {
+            unsigned long long kilobytes = 0;
+            if (std::sscanf(line, "VmRSS: %llu kB", &kilobytes) == 1)
+                usage.resident = (size_t)kilobytes * 1024;
+            else if (std::sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1)
+                usage.peak = (size_t)kilobytes * 1024;
+        }
+        std::fclose(status);
+#endif
+        return usage;
+    }
+
+    // hands memory the allocator holds on to back to the OS. glibc keeps large freed blocks in its heap once it has
+    // seen a few of them, so the resident size only drops after a trim.
+    static void trim()
+    {
+#if !defined(_WIN32) && !defined(__APPLE__) && defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+
+    double residentMb() const
+    {
+        return resident / (1024.0 * 1024.0);
+    }
+
+    double peakMb() const
+    {
+        return peak / (1024.0 * 1024.0);
+    }
+};
+#endif
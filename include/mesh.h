@@ -5,9 +5,19 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <shader.h>
+#include <globject.h>
+#include <glstate.h>
+#include <meshsimplify.h>
+#include <mappedfile.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,110 +35,636 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// 24 byte vertex for the packed layout, less than half of Vertex.
+// Normal and tangent are signed normalized 10-10-10-2 (GL_INT_2_10_10_10_REV), the tangent's 2 bit w holds the
+// handedness so the bitangent can be rebuilt in the shader: cross(normal, tangent.xyz) * sign(tangent.w).
+// (GL 3.3 decodes a 2 bit -1 as -1/3, hence the sign()). Texture coordinates are half floats.
+struct PackedVertex {
+    glm::vec3 Position;
+    uint32_t Normal;
+    uint32_t Tangent;
+    uint16_t TexCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must stay tightly packed");
+
+// the bones moving a vertex and how much each of them does, a separate stream next to the vertices (see
+// Mesh::setBones()). unused slots have weight 0. Assimp's aiProcess_LimitBoneWeights keeps it at 4 bones.
+struct VertexBones {
+    uint16_t Ids[4];
+    float Weights[4];
+};
+
+static_assert(sizeof(VertexBones) == 24, "VertexBones must stay tightly packed");
+
+enum VertexFormat {
+    VERTEX_FLOAT,    // Vertex, every attribute in full floats
+    VERTEX_PACKED    // PackedVertex
+};
+
+inline PackedVertex packVertex(const Vertex& vertex)
+{
+    glm::vec3 normal = glm::normalize(vertex.Normal);
+    // meshes without texture coordinates have no tangent frame, any unit vector will do then
+    glm::vec3 tangent = glm::dot(vertex.Tangent, vertex.Tangent) > 0.0f ? glm::normalize(vertex.Tangent) : glm::vec3(1.0f, 0.0f, 0.0f);
+    float handedness = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, handedness));
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    return packed;
+}
+
+enum TextureType {
+    TEXTURE_DIFFUSE,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_TYPE_COUNT
+};
+
+// sampler name prefix in the shaders, the N-th texture of a type is bound to <prefix>N
+inline const char* textureTypeName(TextureType type)
+{
+    static const char* names[TEXTURE_TYPE_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    return names[type];
+}
+
+// fixed unit of the N-th (1-based) texture of a type: diffuse1 -> 0, specular1 -> 1, normal1 -> 2, height1 -> 3, diffuse2 -> 4 ...
+// every mesh uses the same layout, so a program's sampler uniforms never change between meshes.
+inline unsigned int textureUnit(TextureType type, unsigned int number)
+{
+    return (number - 1) * TEXTURE_TYPE_COUNT + type;
+}
+
 struct Texture {
     unsigned int id;
-    string type;
+    TextureType type;
     string path;
 };
 
+// Owns its vertex array and buffers, a Mesh can be moved but not copied and frees them when it goes away.
+// The CPU copies of the vertices and indices stay until releaseCpuCopies(), see keepCpuCopies(). A mesh made from a
+// cooked file reads the file instead and only fills the copies when loadCpuCopies() asks for them.
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
+    vector<PackedVertex> packedVertices;   // used instead of vertices with VERTEX_PACKED
     vector<unsigned int> indices;
+    vector<unsigned int> lodIndices;       // the simplified levels after the first, uploaded behind indices
+    vector<MeshLod>      lods;             // level 0 is indices, the others ranges of the whole index buffer
+    vector<VertexBones>  bones;            // per vertex, empty unless the mesh is skinned
     vector<Texture>      textures;
-    unsigned int VAO;
+    VertexFormat format;
+    GLenum indexType;   // GL_UNSIGNED_SHORT when every index fits into 16 bits
+    GLVertexArray VAO;
+    GLVertexArray depthVAO;   // positions only, see enablePositionStream()
+    glm::vec3 boundsMin, boundsMax;   // object space bounding box
+    glm::vec3 boundsCentre;           // object space bounding sphere, centred on the box
+    float boundsRadius;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, lodChain holds the simplified levels of indices (see meshsimplify.h)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshLodChain lodChain = MeshLodChain())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->format = VERTEX_FLOAT;
+        setLods(std::move(lodChain));
+        countData();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        setupSamplers();
+        computeBounds();
+    }
+
+    Mesh(vector<PackedVertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshLodChain lodChain = MeshLodChain())
+    {
+        this->packedVertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->format = VERTEX_PACKED;
+        setLods(std::move(lodChain));
+        countData();
+
+        setupMesh();
+        setupSamplers();
+        computeBounds();
+    }
+
+    // uploads GPU-ready data as is, e.g. straight from a memory mapped cooked file (see meshcache.h), without touching
+    // a single vertex. vertexData holds vertexCount vertices in format, indexData indexCount indices of indexType
+    // covering every level of lods (all of them are level 0 when lods is empty). source keeps both alive, the mesh reads
+    // them where others read the CPU copies; without it there are no CPU copies once the constructor returns.
+    Mesh(const void* vertexData, size_t vertexCount, VertexFormat format, const void* indexData, size_t indexCount, GLenum indexType,
+        vector<Texture> textures, glm::vec3 boundsMin, glm::vec3 boundsMax, float boundsRadius, vector<MeshLod> lods = vector<MeshLod>(),
+        std::shared_ptr<const MappedFile> source = nullptr)
+    {
+        this->textures = std::move(textures);
+        this->format = format;
+        this->indexType = indexType;
+        this->boundsMin = boundsMin;
+        this->boundsMax = boundsMax;
+        this->boundsCentre = (boundsMin + boundsMax) * 0.5f;
+        this->boundsRadius = boundsRadius;
+        size_t firstLevel = lods.empty() ? indexCount : std::min((size_t)lods[0].indexCount, indexCount);
+        this->lods.push_back({ 0, (unsigned int)firstLevel, 0.0f });
+        for (size_t level = 1; level < lods.size(); level++)
+            this->lods.push_back(lods[level]);
+        vertexTotal = vertexCount;
+        indexTotal = indexCount;
+        cpuCopies = false;
+        if (source)
+        {
+            this->source = std::move(source);
+            sourceVertices = vertexData;
+            sourceIndices = indexData;
+        }
+
+        setupBuffers(vertexData, indexData);
+        setupSamplers();
+    }
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+
+    // on: releaseCpuCopies() keeps everything, for tools that read the geometry after the upload
+    static bool& keepCpuCopies()
+    {
+        static bool flag = false;
+        return flag;
+    }
+
+    // frees the CPU copies of the vertices and indices and lets go of the cooked file, the GPU buffers, the counts,
+    // the bounds and the levels of detail stay. enablePositionStream() and GeometryArena::add() need the copies and
+    // have to come first.
+    void releaseCpuCopies()
+    {
+        if (keepCpuCopies())
+            return;
+        vector<Vertex>().swap(vertices);
+        vector<PackedVertex>().swap(packedVertices);
+        vector<unsigned int>().swap(indices);
+        vector<unsigned int>().swap(lodIndices);
+        vector<VertexBones>().swap(bones);
+        cpuCopies = false;
+        source.reset();
+        sourceVertices = nullptr;
+        sourceIndices = nullptr;
+    }
+
+    // true until releaseCpuCopies() dropped the vertices and indices. for a mesh made from a cooked file they are
+    // still in the file, vertexData(), position() and appendIndices() read them there.
+    bool hasCpuCopies() const
+    {
+        return cpuCopies || source;
+    }
+
+    // fills vertices, indices and lodIndices from the cooked file, for code that reads them directly. true if they
+    // are there, false after releaseCpuCopies().
+    bool loadCpuCopies()
+    {
+        if (cpuCopies)
+            return true;
+        if (!source)
+            return false;
+        if (format == VERTEX_PACKED)
+            packedVertices.assign((const PackedVertex*)sourceVertices, (const PackedVertex*)sourceVertices + vertexTotal);
+        else
+            vertices.assign((const Vertex*)sourceVertices, (const Vertex*)sourceVertices + vertexTotal);
+        size_t firstLevel = lods[0].indexCount;
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            const uint16_t* data = (const uint16_t*)sourceIndices;
+            indices.assign(data, data + firstLevel);
+            lodIndices.assign(data + firstLevel, data + indexTotal);
+        }
+        else
+        {
+            const unsigned int* data = (const unsigned int*)sourceIndices;
+            indices.assign(data, data + firstLevel);
+            lodIndices.assign(data + firstLevel, data + indexTotal);
+        }
+        cpuCopies = true;
+        return true;
+    }
+
+    // the vertex data as uploaded, in the cooked file until loadCpuCopies()
+    const void* vertexData() const
+    {
+        if (!cpuCopies && source)
+            return sourceVertices;
+        return format == VERTEX_PACKED ? (const void*)packedVertices.data() : (const void*)vertices.data();
+    }
+
+    // the object space position of a vertex, hasCpuCopies() has to be true
+    glm::vec3 position(size_t vertex) const
+    {
+        if (format == VERTEX_PACKED)
+            return ((const PackedVertex*)vertexData())[vertex].Position;
+        return ((const Vertex*)vertexData())[vertex].Position;
+    }
+
+    // appends the indices of every level to out, level 0 first like in the index buffer. hasCpuCopies() has to be true
+    void appendIndices(vector<unsigned int>& out) const
+    {
+        if (cpuCopies)
+        {
+            out.insert(out.end(), indices.begin(), indices.end());
+            out.insert(out.end(), lodIndices.begin(), lodIndices.end());
+        }
+        else if (source && indexType == GL_UNSIGNED_SHORT)
+            out.insert(out.end(), (const uint16_t*)sourceIndices, (const uint16_t*)sourceIndices + indexTotal);
+        else if (source)
+            out.insert(out.end(), (const unsigned int*)sourceIndices, (const unsigned int*)sourceIndices + indexTotal);
+    }
+
+    // vertices in the vertex buffer, the CPU copies may be gone
+    size_t vertexCount() const
+    {
+        return vertexTotal;
+    }
+
+    // bytes of vertex data in the vertex buffer
+    size_t vertexBytes() const
+    {
+        return vertexTotal * (format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex));
+    }
+
+    // bytes of the index buffer, every level included
+    size_t indexBytes() const
+    {
+        return indexTotal * indexSize();
+    }
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+
+    // the index range drawn for a level, levels past the last one get the last one
+    const MeshLod& lod(unsigned int level) const
+    {
+        return lods[std::min((size_t)level, lods.size() - 1)];
+    }
+
+    // adds a tightly packed position stream with its own VAO sharing the index buffer,
+    // DrawDepth() then fetches 12 bytes per vertex instead of the whole vertex
+    void enablePositionStream()
+    {
+        if (positionVBO)
+            return;
+        if (!hasCpuCopies())
+        {
+            std::cout << "ERROR::MESH::POSITION_STREAM_WITHOUT_CPU_COPY" << std::endl;
+            return;
+        }
+        vector<glm::vec3> positions(vertexCount());
+        for (size_t i = 0; i < positions.size(); i++)
+            positions[i] = position(i);
+
+        positionVBO = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, positionVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (VAO)
+            setupVertexArray();
+    }
+
+    // draws only the positions (attribute 0) for depth-only passes, no textures are bound.
+    // without a position stream it falls back to the full vertex VAO.
+    void DrawDepth(unsigned int level = 0)
+    {
+        GLState::current().bindVertexArray(depthVAO ? depthVAO : VAO);
+        drawLevel(level);
+    }
+
+    // render the mesh at a level of detail, the shader has to be in use
+    void Draw(Shader &shader, unsigned int level = 0) 
+    {
+        bindTextures(shader);
+        // draw mesh, the VAO stays bound so drawing the same mesh again binds nothing
+        GLState::current().bindVertexArray(VAO);
+        drawLevel(level);
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
-    {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // reads a glm::mat4 per instance from buffer at attributes 5 to 8 (one column each, advancing once per instance),
+    // DrawInstanced() then draws a copy of the mesh for every matrix. the buffer has to outlive the mesh's use of it.
+    void setInstanceBuffer(GLuint buffer)
+    {
+        instanceBuffer = buffer;
+        if (!VAO)
+            return;
+        GLState::current().bindVertexArray(VAO);
+        setupInstanceAttributes();
+        GLState::current().bindVertexArray(0);
+    }
+
+    // uploads the bone stream of a skinned mesh, one entry per vertex, and reads it at attributes 9 (ids, as
+    // integers) and 10 (weights). the skinned shader permutation moves the vertices with them, see skinning.h.
+    void setBones(vector<VertexBones> vertexBones)
+    {
+        if (vertexBones.size() != vertexTotal)
+        {
+            std::cout << "ERROR::MESH::BONE_COUNT_MISMATCH " << vertexBones.size() << " bones for " << vertexTotal << " vertices" << std::endl;
+            return;
+        }
+        bones = std::move(vertexBones);
+        boneVBO = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, boneVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, bones.size() * sizeof(VertexBones), &bones[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (!VAO)
+            return;
+        GLState::current().bindVertexArray(VAO);
+        setupBoneAttributes();
+        GLState::current().bindVertexArray(0);
     }
 
+    // frees the vertex arrays and the vertex, index and position buffers once the mesh is drawn from elsewhere, e.g.
+    // the geometry arena it was added to. counts, bounds, levels and textures stay, the mesh can't draw itself anymore.
+    void releaseBuffers()
+    {
+        VAO.reset();
+        depthVAO.reset();
+        VBO.reset();
+        EBO.reset();
+        positionVBO.reset();
+    }
+
+    // creates the vertex arrays over the uploaded buffers, with the instance and bone streams and the position stream
+    // when the mesh has them. the constructors do this themselves unless the mesh is made on an upload context (see
+    // GLState::uploadOnly()), the rendering context then has to call it before the first draw.
+    void setupVertexArray()
+    {
+        // nothing to draw from after releaseBuffers()
+        if (!VBO)
+            return;
+        if (!VAO)
+        {
+            VAO = GLVertexArray::create();
+            GLState::current().bindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            setupAttributes(format);
+            if (instanceBuffer)
+                setupInstanceAttributes();
+            if (boneVBO)
+                setupBoneAttributes();
+        }
+        if (positionVBO && !depthVAO)
+        {
+            depthVAO = GLVertexArray::create();
+            GLState::current().bindVertexArray(depthVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        }
+        GLState::current().bindVertexArray(0);
+    }
+
+    // true once setBones() uploaded a bone stream, the CPU copy may be gone
+    bool skinned() const
+    {
+        return boneVBO != 0;
+    }
+
+    // draws count instances of a level of detail, see setInstanceBuffer(). the shader has to be in use.
+    void DrawInstanced(Shader &shader, unsigned int count, unsigned int level = 0)
+    {
+        bindTextures(shader);
+        GLState::current().bindVertexArray(VAO);
+        const MeshLod& range = lod(level);
+        glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, indexType, (void*)(range.firstIndex * indexSize()), count);
+    }
+
+    // binds the mesh's textures for shader, which has to be in use. Draw() does this itself.
+    void bindTextures(Shader &shader)
+    {
+        // point the sampler uniforms at the texture units, once per program
+        if (shader.ID != samplerProgram)
+        {
+            for (const Sampler& sampler : samplers)
+                shader.setInt(sampler.name, (int)sampler.unit);
+            samplerProgram = shader.ID;
+        }
+        // bind appropriate textures, textures already on their unit are skipped
+        for (const Sampler& sampler : samplers)
+            GLState::current().bindTexture(sampler.unit, GL_TEXTURE_2D, sampler.texture);
+    }
+
+    // true when both meshes bind the same textures to the same units
+    bool sameTextures(const Mesh& other) const
+    {
+        if (samplers.size() != other.samplers.size())
+            return false;
+        for (size_t i = 0; i < samplers.size(); i++)
+        {
+            if (samplers[i].unit != other.samplers[i].unit || samplers[i].texture != other.samplers[i].texture)
+                return false;
+        }
+        return true;
+    }
+
+    // points the attributes of the bound VAO at the bound GL_ARRAY_BUFFER holding vertices in format
+    static void setupAttributes(VertexFormat format)
+    {
+        if (format == VERTEX_PACKED)
+        {
+            // vertex Positions
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+            // vertex normals, normalized to [-1, 1]. shaders read them as vec3
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+            // vertex texture coords
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+            // vertex tangent, w is the handedness
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+            // no bitangent, attribute 4 stays disabled
+        }
+        else
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            // set the vertex attribute pointers
+            // vertex Positions
+            glEnableVertexAttribArray(0);	
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            // vertex normals
+            glEnableVertexAttribArray(1);	
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            // vertex texture coords
+            glEnableVertexAttribArray(2);	
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            // vertex tangent
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+            // vertex bitangent
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        }
+    }
+
+    // first of the four attributes holding an instance's model matrix
+    static const unsigned int INSTANCE_ATTRIBUTE = 5;
+    // bone ids, the weights follow at the next attribute
+    static const unsigned int BONE_ATTRIBUTE = 9;
+
 private:
     // render data 
-    unsigned int VBO, EBO;
+    GLBuffer VBO, EBO;
+    GLBuffer positionVBO;
+    GLBuffer boneVBO;
+    GLuint instanceBuffer = 0;   // owned by whoever called setInstanceBuffer()
+    size_t vertexTotal = 0;
+    size_t indexTotal = 0;   // every level
+    bool cpuCopies = true;
+    std::shared_ptr<const MappedFile> source;   // the cooked file the mesh was made from, until releaseCpuCopies()
+    const void* sourceVertices = nullptr;       // in source
+    const void* sourceIndices = nullptr;
+
+    // a texture with its unit and sampler name, resolved when the mesh is created
+    struct Sampler {
+        string name;
+        unsigned int unit;
+        unsigned int texture;
+    };
+    vector<Sampler> samplers;
+    unsigned int samplerProgram = 0;   // program whose sampler uniforms were set last
+
+    // assigns every texture its unit and sampler name (the N in texture_diffuseN counts per type)
+    void setupSamplers()
+    {
+        unsigned int numbers[TEXTURE_TYPE_COUNT] = {};
+        samplers.clear();
+        for (const Texture& texture : textures)
+        {
+            unsigned int number = ++numbers[texture.type];
+            samplers.push_back({ textureTypeName(texture.type) + std::to_string(number), textureUnit(texture.type, number), texture.id });
+        }
+    }
+
+    // level 0 is always the whole of indices, lodChain's levels are taken as they are after it
+    void setLods(MeshLodChain lodChain)
+    {
+        lodIndices = std::move(lodChain.indices);
+        lods.clear();
+        lods.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+        for (size_t level = 1; level < lodChain.levels.size(); level++)
+            lods.push_back(lodChain.levels[level]);
+    }
+
+    // the counts outlive the CPU copies
+    void countData()
+    {
+        vertexTotal = format == VERTEX_PACKED ? packedVertices.size() : vertices.size();
+        indexTotal = indices.size() + lodIndices.size();
+    }
+
+    void drawLevel(unsigned int level)
+    {
+        const MeshLod& range = lod(level);
+        glDrawElements(GL_TRIANGLES, range.indexCount, indexType, (void*)(range.firstIndex * indexSize()));
+    }
+
+    void computeBounds()
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        for (size_t i = 0; i < vertexCount(); i++)
+        {
+            const glm::vec3& position = format == VERTEX_PACKED ? packedVertices[i].Position : vertices[i].Position;
+            boundsMin = i ? glm::min(boundsMin, position) : position;
+            boundsMax = i ? glm::max(boundsMax, position) : position;
+        }
+        computeSphere();
+    }
+
+    // the sphere around the vertices centred on the box, a little tighter than the one around the box
+    void computeSphere()
+    {
+        boundsCentre = (boundsMin + boundsMax) * 0.5f;
+        float radius2 = 0.0f;
+        for (size_t i = 0; i < vertexCount(); i++)
+        {
+            glm::vec3 offset = (format == VERTEX_PACKED ? packedVertices[i].Position : vertices[i].Position) - boundsCentre;
+            radius2 = std::max(radius2, glm::dot(offset, offset));
+        }
+        boundsRadius = std::sqrt(radius2);
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        // meshes with fewer than 65536 vertices get half size indices
+        indexType = vertexCount() < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            shortIndices.insert(shortIndices.end(), lodIndices.begin(), lodIndices.end());
+            setupBuffers(vertexData(), shortIndices.data());
+        }
+        else if (!lodIndices.empty())
+        {
+            vector<unsigned int> allIndices(indices);
+            allIndices.insert(allIndices.end(), lodIndices.begin(), lodIndices.end());
+            setupBuffers(vertexData(), allIndices.data());
+        }
+        else
+            setupBuffers(vertexData(), indices.data());
+    }
+
+    // creates the buffers from data in the mesh's format and index type, counts come from the CPU copies.
+    // they are filled through GL_COPY_WRITE_BUFFER, which no vertex array records, so this works on any context.
+    void setupBuffers(const void* vertexData, const void* indexData)
+    {
+        // create buffers
+        VBO = GLBuffer::create();
+        EBO = GLBuffer::create();
 
-        glBindVertexArray(VAO);
         // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes(), vertexData, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexBytes(), indexData, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        if (!GLState::current().uploadOnly())
+            setupVertexArray();
+    }
+
+    // the instance matrices at attributes 5 to 8 of the bound VAO
+    void setupInstanceAttributes()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 1);
+        }
+    }
+
+    // the bone ids and weights at attributes 9 and 10 of the bound VAO
+    void setupBoneAttributes()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, boneVBO);
+        glEnableVertexAttribArray(BONE_ATTRIBUTE);
+        glVertexAttribIPointer(BONE_ATTRIBUTE, 4, GL_UNSIGNED_SHORT, sizeof(VertexBones), (void*)offsetof(VertexBones, Ids));
+        glEnableVertexAttribArray(BONE_ATTRIBUTE + 1);
+        glVertexAttribPointer(BONE_ATTRIBUTE + 1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBones), (void*)offsetof(VertexBones, Weights));
     }
 };
 #endif
\ No newline at end of file
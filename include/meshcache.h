@@ -0,0 +1,301 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <importprofile.h>
+#include <mappedfile.h>
+#include <mesh.h>
+#include <meshoptimize.h>
+#include <profiler.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Cooked copies of imported models: the final vertex and index buffers of every mesh in GPU layout, plus material
+// texture references and bounds. A cooked file is memory mapped and its buffers are handed to GL as they are,
+// so loading a model skips Assimp and all per-vertex work. The meshes keep the mapping as their CPU copy. Files are keyed by source path and vertex format and
+// record the source file's size and modification time; a changed source, format, import profile, optimizer or LOD
+// setting re-imports.
+//
+// file layout, little endian, vertex and index blocks 16 byte aligned:
+//     Header, MeshRecord[meshCount], then per mesh its texture records, LOD table, vertex data and index data.
+//     a texture record is uint32 type, uint32 path length and the path bytes, the LOD table is MeshLod[lodCount].
+//     the index data holds every level of detail.
+class MeshCache
+{
+public:
+    struct TextureRef {
+        TextureType type;
+        std::string path;   // relative to the model's directory, as the material names it
+    };
+
+    // one mesh of an opened cooked file, the pointers point into the mapping
+    struct MeshView {
+        const void* vertices;
+        size_t vertexCount;
+        const void* indices;
+        size_t indexCount;
+        GLenum indexType;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        float boundsRadius;
+        std::vector<TextureRef> textures;
+        std::vector<MeshLod> lods;
+    };
+
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    static std::string& directory()
+    {
+        static std::string dir = "meshcache";
+        return dir;
+    }
+
+    // maps the cooked file of sourcePath if there is an up to date one. the views stay valid while file is open.
+    static bool open(const std::string& sourcePath, VertexFormat format, ImportProfile profile, MappedFile& file, std::vector<MeshView>& meshes)
+    {
+        if (!enabled())
+            return false;
+        PROFILE_ZONE("MeshCache::open");
+        Header expected;
+        if (!describe(sourcePath, format, profile, expected) || !file.open(path(sourcePath, format)))
+            return false;
+        const char* data = file.data();
+        size_t size = file.size();
+        Header header;
+        if (size < sizeof(Header))
+            return false;
+        std::memcpy(&header, data, sizeof(Header));
+        if (std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version || header.sourceSize != expected.sourceSize
+            || header.sourceTime != expected.sourceTime || header.vertexFormat != expected.vertexFormat || header.optimized != expected.optimized
+            || header.importProfile != expected.importProfile || header.lodLevels != expected.lodLevels)
+        {
+            file.close();
+            return false;
+        }
+        if (sizeof(Header) + (uint64_t)header.meshCount * sizeof(MeshRecord) > size)
+            return corrupt(sourcePath, file);
+
+        size_t vertexSize = format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+        meshes.clear();
+        for (uint32_t m = 0; m < header.meshCount; m++)
+        {
+            MeshRecord record;
+            std::memcpy(&record, data + sizeof(Header) + m * sizeof(MeshRecord), sizeof(MeshRecord));
+            size_t indexSize = record.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+            if (record.vertexOffset + (uint64_t)record.vertexCount * vertexSize > size || record.indexOffset + (uint64_t)record.indexCount * indexSize > size)
+                return corrupt(sourcePath, file);
+
+            MeshView view;
+            view.vertices = data + record.vertexOffset;
+            view.vertexCount = record.vertexCount;
+            view.indices = data + record.indexOffset;
+            view.indexCount = record.indexCount;
+            view.indexType = record.indexType;
+            view.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+            view.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+            view.boundsRadius = record.boundsRadius;
+            uint64_t offset = record.textureOffset;
+            for (uint32_t t = 0; t < record.textureCount; t++)
+            {
+                uint32_t type = 0, length = 0;
+                if (offset + 8 > size)
+                    return corrupt(sourcePath, file);
+                std::memcpy(&type, data + offset, 4);
+                std::memcpy(&length, data + offset + 4, 4);
+                if (type >= TEXTURE_TYPE_COUNT || offset + 8 + length > size)
+                    return corrupt(sourcePath, file);
+                view.textures.push_back({ (TextureType)type, std::string(data + offset + 8, length) });
+                offset += 8 + length;
+            }
+            if (record.lodOffset + (uint64_t)record.lodCount * sizeof(MeshLod) > size)
+                return corrupt(sourcePath, file);
+            view.lods.resize(record.lodCount);
+            if (record.lodCount)
+                std::memcpy(view.lods.data(), data + record.lodOffset, record.lodCount * sizeof(MeshLod));
+            for (const MeshLod& lod : view.lods)
+            {
+                if ((uint64_t)lod.firstIndex + lod.indexCount > record.indexCount)
+                    return corrupt(sourcePath, file);
+            }
+            meshes.push_back(view);
+        }
+        return true;
+    }
+
+    // writes the cooked file of sourcePath from meshes loaded with format and profile
+    static void save(const std::string& sourcePath, VertexFormat format, ImportProfile profile, const std::vector<Mesh>& meshes)
+    {
+        if (!enabled() || meshes.empty())
+            return;
+        PROFILE_ZONE("MeshCache::save");
+        Header header;
+        if (!describe(sourcePath, format, profile, header))
+            return;
+        header.meshCount = (uint32_t)meshes.size();
+
+        // lay out the blocks first so the records can be written up front
+        std::vector<MeshRecord> records(meshes.size());
+        uint64_t offset = sizeof(Header) + meshes.size() * sizeof(MeshRecord);
+        for (size_t m = 0; m < meshes.size(); m++)
+        {
+            const Mesh& mesh = meshes[m];
+            MeshRecord& record = records[m];
+            record.vertexCount = (uint32_t)mesh.vertexCount();
+            record.indexCount = (uint32_t)(mesh.indices.size() + mesh.lodIndices.size());
+            record.indexType = mesh.indexType;
+            record.textureCount = (uint32_t)mesh.textures.size();
+            for (int i = 0; i < 3; i++)
+            {
+                record.boundsMin[i] = mesh.boundsMin[i];
+                record.boundsMax[i] = mesh.boundsMax[i];
+            }
+            record.boundsRadius = mesh.boundsRadius;
+            record.textureOffset = offset;
+            for (const Texture& texture : mesh.textures)
+                offset += 8 + texture.path.size();
+            record.lodCount = (uint32_t)mesh.lods.size();
+            record.lodOffset = offset;
+            offset += mesh.lods.size() * sizeof(MeshLod);
+            record.vertexOffset = align(offset);
+            record.indexOffset = align(record.vertexOffset + mesh.vertexBytes());
+            offset = record.indexOffset + mesh.indexBytes();
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(directory(), error);
+        std::string target = path(sourcePath, format);
+        std::ofstream file(target, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::MESHCACHE::COULD_NOT_WRITE " << target << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)records.data(), records.size() * sizeof(MeshRecord));
+        for (size_t m = 0; m < meshes.size(); m++)
+        {
+            const Mesh& mesh = meshes[m];
+            for (const Texture& texture : mesh.textures)
+            {
+                uint32_t type = texture.type, length = (uint32_t)texture.path.size();
+                file.write((const char*)&type, 4);
+                file.write((const char*)&length, 4);
+                file.write(texture.path.data(), length);
+            }
+            file.write((const char*)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            pad(file, records[m].vertexOffset);
+            file.write((const char*)mesh.vertexData(), mesh.vertexBytes());
+            pad(file, records[m].indexOffset);
+            if (mesh.indexType == GL_UNSIGNED_SHORT)
+            {
+                std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+                shortIndices.insert(shortIndices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+                file.write((const char*)shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+            }
+            else
+            {
+                file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+                file.write((const char*)mesh.lodIndices.data(), mesh.lodIndices.size() * sizeof(unsigned int));
+            }
+        }
+    }
+
+private:
+    // 4: skinned models are no longer cooked, files of older versions may hold them without their bones
+    // 5: the bounding sphere's radius, loading reads no vertex
+    static const uint32_t VERSION = 5;
+
+    struct Header {
+        char magic[4] = { 'M', 'E', 'S', 'H' };
+        uint32_t version = VERSION;
+        uint64_t sourceSize = 0;
+        int64_t sourceTime = 0;
+        uint32_t vertexFormat = 0;
+        uint32_t optimized = 0;   // MeshOptimizer was on
+        uint32_t meshCount = 0;
+        uint32_t importProfile = 0;
+        uint32_t lodLevels = 0;   // MeshSimplifier::maxLevels(), 0 when it was off
+        uint32_t pad = 0;
+    };
+
+    struct MeshRecord {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexType;
+        uint32_t textureCount;
+        uint32_t lodCount;
+        float boundsRadius;   // of the sphere centred on the box
+        uint64_t lodOffset;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t textureOffset;
+        float boundsMin[3];
+        float boundsMax[3];
+    };
+
+    // the header an up to date cooked file of sourcePath has
+    static bool describe(const std::string& sourcePath, VertexFormat format, ImportProfile profile, Header& header)
+    {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(sourcePath, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(sourcePath, error);
+        if (error)
+            return false;
+        header.sourceSize = size;
+        header.sourceTime = (int64_t)time.time_since_epoch().count();
+        header.vertexFormat = format;
+        header.optimized = MeshOptimizer::enabled() ? 1 : 0;
+        header.importProfile = profile;
+        header.lodLevels = MeshSimplifier::enabled() ? MeshSimplifier::maxLevels() : 0;
+        return true;
+    }
+
+    static std::string path(const std::string& sourcePath, VertexFormat format)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : sourcePath)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx-%u.mesh", (unsigned long long)hash, (unsigned int)format);
+        return directory() + "/" + name;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    static void pad(std::ofstream& file, uint64_t offset)
+    {
+        static const char zeros[16] = {};
+        uint64_t position = (uint64_t)file.tellp();
+        if (offset > position)
+            file.write(zeros, (std::streamsize)(offset - position));
+    }
+
+    static bool corrupt(const std::string& sourcePath, MappedFile& file)
+    {
+        std::cout << "mesh cache: cooked copy of " << sourcePath << " is damaged, importing again" << std::endl;
+        file.close();
+        return false;
+    }
+};
+#endif
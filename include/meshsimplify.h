@@ -0,0 +1,307 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <meshoptimize.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one level of detail: a range of the mesh's index buffer and how far it strays from the full mesh
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;            // object space distance, 0 for the full mesh
+};
+
+// the simplified levels of a mesh, level 0 is the mesh's own index list and not stored in indices
+struct MeshLodChain {
+    std::vector<unsigned int> indices;   // every level after the first, back to back
+    std::vector<MeshLod> levels;
+};
+
+// Level of detail generation by edge collapse with quadric error metrics (Garland & Heckbert 1997).
+// Vertices only ever collapse onto a neighbour, so every level indexes the mesh's own vertex buffer and a chain costs
+// nothing but index lists. Vertices on open borders and on attribute seams (a position shared by several vertices)
+// never move, which keeps the UV layout and silhouette intact at the price of a less aggressive reduction there.
+class MeshSimplifier
+{
+public:
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    // simplified levels per mesh besides the full one, each aims at half the triangles of the one before
+    static unsigned int& maxLevels()
+    {
+        static unsigned int levels = 4;
+        return levels;
+    }
+
+    // prints the triangle counts and errors of every chain
+    static bool& verbose()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    // builds the chain for a mesh whose final vertex order is set, V needs a glm::vec3 Position.
+    // level 0 covers indices as they are, the other levels are appended after indexCount = indices.size().
+    template <typename V>
+    static MeshLodChain buildChain(const std::vector<V>& vertices, const std::vector<unsigned int>& indices, const std::string& name)
+    {
+        MeshLodChain chain;
+        chain.levels.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+        if (!enabled() || indices.size() < MIN_TRIANGLES * 3 * 2)
+            return chain;
+        PROFILE_ZONE("MeshSimplifier::buildChain");
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            positions[v] = vertices[v].Position;
+
+        Collapser collapser(indices, positions);
+        size_t previous = indices.size();
+        for (unsigned int level = 1; level <= maxLevels(); level++)
+        {
+            size_t target = previous / 2 / 3 * 3;
+            if (target < MIN_TRIANGLES * 3)
+                break;
+            collapser.run(target);
+            // stop once the locked vertices keep it from getting much smaller
+            if (collapser.result.size() > previous * 8 / 10)
+                break;
+            std::vector<unsigned int> levelIndices = collapser.result;
+            if (MeshOptimizer::enabled())
+            {
+                std::vector<size_t> clusters;
+                MeshOptimizer::optimizeVertexCache(levelIndices, vertices.size(), clusters);
+            }
+            chain.levels.push_back({ (unsigned int)(indices.size() + chain.indices.size()), (unsigned int)levelIndices.size(), collapser.error() });
+            chain.indices.insert(chain.indices.end(), levelIndices.begin(), levelIndices.end());
+            previous = levelIndices.size();
+        }
+
+        if (verbose() && chain.levels.size() > 1)
+        {
+            std::ostringstream line;
+            line << "mesh lod: " << name;
+            for (const MeshLod& lod : chain.levels)
+                line << (lod.firstIndex ? " | " : " ") << lod.indexCount / 3 << " triangles error " << lod.error;
+            line << "\n";
+            std::cout << line.str() << std::flush;
+        }
+        return chain;
+    }
+
+private:
+    static const size_t MIN_TRIANGLES = 32;
+
+    // sum of squared distances to a set of planes, stored as the upper triangle of the symmetric 4x4 matrix
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+
+        void addPlane(const glm::dvec3& n, double d)
+        {
+            a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z;
+            a11 += n.y * n.y; a12 += n.y * n.z; a22 += n.z * n.z;
+            b0 += n.x * d; b1 += n.y * d; b2 += n.z * d;
+            c += d * d;
+        }
+
+        void add(const Quadric& q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+        }
+
+        double evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z + a22 * z * z
+                + 2 * (b0 * x + b1 * y + b2 * z) + c;
+            return result > 0.0 ? result : 0.0;
+        }
+    };
+
+    // the state of one mesh being simplified, run() continues where the last call stopped
+    struct Collapser {
+        const std::vector<glm::vec3>& positions;
+        std::vector<unsigned int> result;
+        std::vector<Quadric> quadrics;
+        std::vector<bool> locked;
+        double maxCost = 0.0;
+
+        Collapser(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions)
+            : positions(positions), result(indices), quadrics(positions.size()), locked(positions.size(), false)
+        {
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                glm::dvec3 p0 = positions[indices[t]], p1 = positions[indices[t + 1]], p2 = positions[indices[t + 2]];
+                glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+                double length = glm::length(n);
+                if (length == 0.0)
+                    continue;
+                n /= length;
+                for (unsigned int corner = 0; corner < 3; corner++)
+                    quadrics[indices[t + corner]].addPlane(n, -glm::dot(n, p0));
+            }
+
+            // an edge used by a single triangle is a border, seams show up as borders too since their sides
+            // have different vertices
+            std::unordered_map<uint64_t, unsigned int> edges;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                for (unsigned int corner = 0; corner < 3; corner++)
+                    edges[edgeKey(indices[t + corner], indices[t + (corner + 1) % 3])]++;
+            }
+            for (const auto& edge : edges)
+            {
+                if (edge.second == 1)
+                {
+                    locked[(unsigned int)(edge.first >> 32)] = true;
+                    locked[(unsigned int)edge.first] = true;
+                }
+            }
+            // seam vertices whose copies only touch at a point, like the poles of a UV sphere
+            std::vector<unsigned int> order(positions.size());
+            for (unsigned int v = 0; v < order.size(); v++)
+                order[v] = v;
+            std::sort(order.begin(), order.end(), [&](unsigned int x, unsigned int y) {
+                const glm::vec3& p = positions[x];
+                const glm::vec3& q = positions[y];
+                return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+            });
+            for (size_t i = 1; i < order.size(); i++)
+            {
+                if (positions[order[i]] == positions[order[i - 1]])
+                    locked[order[i]] = locked[order[i - 1]] = true;
+            }
+        }
+
+        // object space distance of the worst collapse so far
+        float error() const
+        {
+            return (float)std::sqrt(maxCost);
+        }
+
+        // collapses edges, cheapest first, until at most targetIndexCount indices are left or nothing can collapse
+        void run(size_t targetIndexCount)
+        {
+            struct Collapse {
+                double cost;
+                unsigned int from, to;
+            };
+            std::vector<Collapse> candidates;
+            std::vector<unsigned int> remap(positions.size());
+            std::vector<bool> touched(positions.size());
+            std::vector<size_t> offsets(positions.size() + 1);
+            std::vector<unsigned int> adjacency;
+
+            while (result.size() > targetIndexCount)
+            {
+                // vertex -> triangles of the current result for the flip test
+                std::fill(offsets.begin(), offsets.end(), 0);
+                for (unsigned int index : result)
+                    offsets[index + 1]++;
+                for (size_t v = 0; v < positions.size(); v++)
+                    offsets[v + 1] += offsets[v];
+                adjacency.resize(result.size());
+                std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < result.size(); i++)
+                    adjacency[fill[result[i]]++] = (unsigned int)(i / 3);
+
+                candidates.clear();
+                for (size_t t = 0; t < result.size(); t += 3)
+                {
+                    for (unsigned int corner = 0; corner < 3; corner++)
+                    {
+                        unsigned int a = result[t + corner], b = result[t + (corner + 1) % 3];
+                        if (!locked[a])
+                            candidates.push_back({ quadrics[a].evaluate(positions[b]), a, b });
+                        if (!locked[b])
+                            candidates.push_back({ quadrics[b].evaluate(positions[a]), b, a });
+                    }
+                }
+                if (candidates.empty())
+                    return;
+                std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+                // a vertex takes part in one collapse per pass, so the flip tests see the triangles as they will be
+                for (unsigned int v = 0; v < positions.size(); v++)
+                    remap[v] = v;
+                std::fill(touched.begin(), touched.end(), false);
+                size_t trianglesToGo = (result.size() - targetIndexCount) / 3;
+                size_t removed = 0;
+                for (const Collapse& collapse : candidates)
+                {
+                    if (removed >= trianglesToGo)
+                        break;
+                    if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to, offsets, adjacency))
+                        continue;
+                    remap[collapse.from] = collapse.to;
+                    quadrics[collapse.to].add(quadrics[collapse.from]);
+                    maxCost = std::max(maxCost, collapse.cost);
+                    // the neighbours' triangles change shape, they wait for the next pass
+                    for (size_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+                    {
+                        size_t t = adjacency[a] * 3;
+                        bool shared = result[t] == collapse.to || result[t + 1] == collapse.to || result[t + 2] == collapse.to;
+                        removed += shared ? 1 : 0;
+                        touched[result[t]] = touched[result[t + 1]] = touched[result[t + 2]] = true;
+                    }
+                }
+                if (removed == 0)
+                    return;
+
+                std::vector<unsigned int> next;
+                next.reserve(result.size());
+                for (size_t t = 0; t < result.size(); t += 3)
+                {
+                    unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                    if (a != b && b != c && a != c)
+                        next.insert(next.end(), { a, b, c });
+                }
+                result.swap(next);
+            }
+        }
+
+        // true when moving from onto to turns one of from's remaining triangles over or nearly so
+        bool flips(unsigned int from, unsigned int to, const std::vector<size_t>& offsets, const std::vector<unsigned int>& adjacency) const
+        {
+            const glm::vec3& target = positions[to];
+            for (size_t a = offsets[from]; a < offsets[from + 1]; a++)
+            {
+                size_t t = adjacency[a] * 3;
+                unsigned int v0 = result[t], v1 = result[t + 1], v2 = result[t + 2];
+                if (v0 == to || v1 == to || v2 == to)
+                    continue;
+                glm::vec3 p0 = positions[v0], p1 = positions[v1], p2 = positions[v2];
+                glm::vec3 before = glm::cross(p1 - p0, p2 - p0);
+                (v0 == from ? p0 : v1 == from ? p1 : p2) = target;
+                glm::vec3 after = glm::cross(p1 - p0, p2 - p0);
+                // folds count as well as flips, a triangle may turn by up to about 75 degrees
+                if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                    return true;
+            }
+            return false;
+        }
+
+        static uint64_t edgeKey(unsigned int a, unsigned int b)
+        {
+            return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        }
+    };
+};
+#endif
@@ -12,230 +12,774 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include <globject.h>
+#include <glstate.h>
+#include <profiler.h>
+#include <meshoptimize.h>
+#include <meshcache.h>
+#include <importprofile.h>
+#include <geometryarena.h>
+#include <lodselect.h>
+#include <threadpool.h>
+#include <texturecache.h>
+#include <frustum.h>
+#include <animation.h>
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// the texture at path relative to directory, shared with everyone else who loads it (see texturecache.h)
+TextureHandle TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// Owns its meshes and holds the textures they use, a Model can be moved but not copied and frees everything when it
+// goes away. Textures come from TextureCache, models loading the same files share them.
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// the textures the model uses, every file once
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat;
+    ImportProfile importProfile;
+    ImportStats importStats;    // what loading took, printed when the model is loaded
+    LodSelector lod;            // the level of detail Draw() uses, see selectLod()
+    Skeleton skeleton;          // empty unless a mesh has bones
+    vector<Animation> animations;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // format picks the vertex layout of the meshes, VERTEX_PACKED quantizes them to PackedVertex.
+    // profile picks the Assimp post-processing, see importprofile.h.
+    Model(string const &path, bool gamma = false, VertexFormat format = VERTEX_FLOAT, ImportProfile profile = IMPORT_RENDER_OPTIMAL)
+        : gammaCorrection(gamma), vertexFormat(format), importProfile(profile)
     {
         loadModel(path);
     }
 
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        DrawLevel(shader, lod.level);
+    }
+
+    // draws every mesh at a level of detail, meshes with fewer levels use their last one. meshes the last cull()
+    // found outside the frustum are skipped.
+    void DrawLevel(Shader &shader, unsigned int level)
+    {
+        bool fromArena = arena && arena->isBuilt();
+        if (fromArena)
+            drawArena(&shader, level);
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            if (meshVisible(i) && !(fromArena && inArena[i]))
+                meshes[i].Draw(shader, level);
+        }
+    }
+
+    // tests every mesh, placed by model, against frustum and keeps the result for the draws up to the next cull().
+    // the sphere around the whole model settles all meshes at once when it is completely in or out.
+    // returns true if any mesh is visible.
+    bool cull(const Frustum& frustum, const glm::mat4& model)
+    {
+        if (meshes.empty())
+            return false;
+        Frustum::Containment containment = frustum.sphere(glm::vec3(model * glm::vec4(boundsCentre, 1.0f)), boundsRadius * Frustum::maxScale(model));
+        if (containment != Frustum::INTERSECTING)
+        {
+            bool inside = containment == Frustum::INSIDE;
+            visible.assign(meshes.size(), inside);
+            frustum.count(inside, (unsigned int)meshes.size());
+            return inside;
+        }
+        bool any = false;
+        visible.resize(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const Mesh& mesh = meshes[i];
+            visible[i] = frustum.visible(model, mesh.boundsMin, mesh.boundsMax, mesh.boundsCentre, mesh.boundsRadius);
+            any = any || visible[i];
+        }
+        return any;
+    }
+
+    // false if the last cull() found the mesh outside, every mesh is visible before the first
+    bool meshVisible(size_t mesh) const
+    {
+        return mesh >= visible.size() || visible[mesh];
+    }
+
+    // see Mesh::setInstanceBuffer()
+    void setInstanceBuffer(GLuint buffer)
+    {
+        for (Mesh& mesh : meshes)
+            mesh.setInstanceBuffer(buffer);
+    }
+
+    // draws count instances of every mesh at a level of detail, one draw call per mesh
+    void DrawInstanced(Shader &shader, unsigned int count, unsigned int level = 0)
+    {
+        for (Mesh& mesh : meshes)
+            mesh.DrawInstanced(shader, count, level);
+    }
+
+    // true if the meshes carry bones, they then need the skinned shader permutation and a bone palette
+    bool skinned() const
+    {
+        return !skeleton.empty();
+    }
+
+    // object space sphere around all meshes
+    glm::vec3 boundingCentre() const
+    {
+        return boundsCentre;
+    }
+
+    float boundingRadius() const
+    {
+        return boundsRadius;
+    }
+
+    // moves the drawing into arena (see geometryarena.h), which has to be built before the next Draw().
+    // consecutive meshes with the same textures are drawn with one submission. the meshes free their own buffers,
+    // their geometry is only in the arena afterwards. a mesh the arena turns down keeps its buffers and is still
+    // drawn on its own.
+    void addTo(GeometryArena& target)
+    {
+        arena = &target;
+        vector<int> slots;
+        inArena.assign(meshes.size(), false);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            slots.push_back(arena->add(meshes[i]));
+            inArena[i] = slots[i] >= 0;
+            if (inArena[i])
+                meshes[i].releaseBuffers();
+        }
+        // the commands of one level are consecutive so a level's meshes can go out together
+        arenaBatches.assign(lodLevels(), vector<ArenaBatch>());
+        for (unsigned int level = 0; level < arenaBatches.size(); level++)
+        {
+            vector<ArenaBatch>& batches = arenaBatches[level];
+            for (unsigned int i = 0; i < meshes.size(); i++)
+            {
+                if (!inArena[i])
+                    continue;
+                unsigned int command = arena->addDraw((unsigned int)slots[i], level);
+                // a batch only grows over neighbouring meshes, command firstCommand + k has to draw mesh + k
+                const ArenaBatch* last = batches.empty() ? nullptr : &batches.back();
+                if (last && last->mesh + last->commandCount == i && meshes[last->mesh].sameTextures(meshes[i]))
+                    batches.back().commandCount++;
+                else
+                    batches.push_back({ i, command, 1 });
+            }
+        }
+    }
+
+    // triangles drawn at a level of detail
+    size_t triangles(unsigned int level) const
+    {
+        size_t count = 0;
+        for (const Mesh& mesh : meshes)
+            count += mesh.lod(level).indexCount / 3;
+        return count;
+    }
+
+    // levels of detail of the mesh with the most
+    unsigned int lodLevels() const
+    {
+        size_t levels = 1;
+        for (const Mesh& mesh : meshes)
+            levels = std::max(levels, mesh.lods.size());
+        return (unsigned int)levels;
+    }
+
+    // picks the level of detail for the next frames from how large the simplification error of each level would
+    // appear on screen. model places the model in the world, fovy is the vertical field of view in degrees
+    // (camera.Zoom) and viewportHeight is in pixels.
+    void selectLod(const glm::mat4& model, const glm::vec3& viewPos, float fovy, float viewportHeight, float dt)
+    {
+        if (lodErrors.size() != lodLevels())
+            computeLodErrors();
+        glm::vec3 centre = glm::vec3(model * glm::vec4(boundsCentre, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float distance = glm::length(centre - viewPos) - boundsRadius * scale;
+        lod.update(lodErrors, scale, distance, fovy, viewportHeight, dt);
+    }
+
+    // see Mesh::enablePositionStream(), needs the CPU copies of the vertices. after addTo() the stream goes into the
+    // arena instead, which must not be built yet.
+    void enablePositionStream()
+    {
+        if (arena)
+            arena->enablePositionStream();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (!arena || !inArena[i])
+                meshes[i].enablePositionStream();
+        }
+    }
+
+    // see Mesh::setupVertexArray(), for a model made on an upload context. the arena the model was added to gets its
+    // vertex array as well.
+    void setupVertexArrays()
+    {
+        for (Mesh& mesh : meshes)
+            mesh.setupVertexArray();
+        if (arena)
+            arena->setupVertexArray();
+    }
+
+    // frees the CPU copies of every mesh unless Mesh::keepCpuCopies() is set. call it once the model is set up,
+    // after enablePositionStream() and addTo()
+    void releaseCpuCopies()
+    {
+        for (Mesh& mesh : meshes)
+            mesh.releaseCpuCopies();
+    }
+
+    // depth-only draw of all meshes, the shader only needs aPos at location 0
+    void DrawDepth()
+    {
+        DrawDepthLevel(lod.level);
+    }
+
+    void DrawDepthLevel(unsigned int level)
+    {
+        bool fromArena = arena && arena->isBuilt();
+        if (fromArena)
+            drawArena(nullptr, level);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (meshVisible(i) && !(fromArena && inArena[i]))
+                meshes[i].DrawDepth(level);
+        }
+    }
+
+    // bytes of vertex data of all meshes on the GPU
+    size_t vertexBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.vertexBytes();
+        return bytes;
+    }
+
+    // true if any material of the model has a texture of this type. asks the meshes, textures_loaded only has the
+    // type a file was first loaded as and misses a file that also serves as another map.
+    bool hasTexture(TextureType type) const
+    {
+        for (const Mesh& mesh : meshes)
+        {
+            for (const Texture& texture : mesh.textures)
+            {
+                if (texture.type == type)
+                    return true;
+            }
+        }
+        return false;
     }
     
 private:
+    // meshes drawn together from the arena, they share the textures of meshes[mesh]
+    struct ArenaBatch {
+        unsigned int mesh;
+        unsigned int firstCommand;
+        unsigned int commandCount;
+    };
+    unordered_map<string, TextureHandle> textureHandles;   // textures_loaded by path, keeps them alive
+    GeometryArena* arena = nullptr;
+    vector<vector<ArenaBatch>> arenaBatches;   // per level of detail
+    vector<bool> inArena;   // per mesh, false for meshes the arena turned down
+    vector<bool> visible;   // per mesh, from the last cull()
+
+    vector<float> lodErrors;    // per level, the largest error of any mesh
+    glm::vec3 boundsCentre = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+
+    // draws a level from the arena, depth only without a shader. command firstCommand + k of a batch draws mesh + k,
+    // the visible runs of a batch still go out together.
+    void drawArena(Shader* shader, unsigned int level)
+    {
+        for (const ArenaBatch& batch : arenaBatches[std::min((size_t)level, arenaBatches.size() - 1)])
+        {
+            bool bound = false;
+            unsigned int k = 0;
+            while (k < batch.commandCount)
+            {
+                unsigned int first = k;
+                while (k < batch.commandCount && meshVisible(batch.mesh + k))
+                    k++;
+                if (k == first)
+                {
+                    k++;
+                    continue;
+                }
+                if (!shader)
+                {
+                    arena->drawDepth(batch.firstCommand + first, k - first);
+                    continue;
+                }
+                if (!bound)
+                    meshes[batch.mesh].bindTextures(*shader);
+                bound = true;
+                arena->draw(batch.firstCommand + first, k - first);
+            }
+        }
+    }
+
+    void computeLodErrors()
+    {
+        lodErrors.assign(lodLevels(), 0.0f);
+        for (const Mesh& mesh : meshes)
+        {
+            for (unsigned int level = 0; level < lodErrors.size(); level++)
+                lodErrors[level] = std::max(lodErrors[level], mesh.lod(level).error);
+        }
+    }
+
+    void computeBounds()
+    {
+        glm::vec3 low(0.0f), high(0.0f);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            low = i ? glm::min(low, meshes[i].boundsMin) : meshes[i].boundsMin;
+            high = i ? glm::max(high, meshes[i].boundsMax) : meshes[i].boundsMax;
+        }
+        boundsCentre = (low + high) * 0.5f;
+        boundsRadius = glm::length(high - low) * 0.5f;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // a cooked copy (see meshcache.h) is used when it is up to date, Assimp only runs to create it.
     void loadModel(string const &path)
     {
+        PROFILE_ZONE("Model::loadModel");
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        importStats = ImportStats();
+        importStats.profile = importProfile;
+        if (loadCooked(path))
+        {
+            computeBounds();
+            importStats.print(path);
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene;
+        {
+            ImportMonitor monitor(importStats, importProfile == IMPORT_DEBUG);
+            importer.SetProgressHandler(&monitor);
+            scene = importer.ReadFile(path, importFlags(importProfile));
+            importer.SetProgressHandler(nullptr);
+        }
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
-
+        // the bones are numbered model wide before the meshes refer to them
+        skeleton = Skeleton(scene);
+        for (unsigned int i = 0; !skeleton.empty() && i < scene->mNumAnimations; i++)
+            animations.push_back(Animation(scene->mAnimations[i], skeleton));
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        vector<aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        processMeshes(sceneMeshes, scene);
+        computeBounds();
+        // the cooked format has no bones or animations, skinned models are imported every time
+        if (!skinned())
+        {
+            int64_t start = Profiler::now();
+            MeshCache::save(path, vertexFormat, importProfile, meshes);
+            importStats.addStep("write mesh cache", (Profiler::now() - start) / 1e6);
+        }
+        importStats.print(path);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // builds the meshes straight from the memory mapped cooked file
+    bool loadCooked(string const &path)
     {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        // the meshes hold on to the mapping, it stands in for their CPU copies
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        vector<MeshCache::MeshView> views;
+        int64_t start = Profiler::now();
+        if (!MeshCache::open(path, vertexFormat, importProfile, *file, views))
+            return false;
+        PROFILE_ZONE("Model::loadCooked");
+        importStats.cooked = true;
+        importStats.addStep("map mesh cache", (Profiler::now() - start) / 1e6);
+        vector<string> paths;
+        for (const MeshCache::MeshView& view : views)
+        {
+            for (const MeshCache::TextureRef& ref : view.textures)
+                paths.push_back(ref.path);
+        }
+        start = Profiler::now();
+        decodeTextures(paths);
+        importStats.addStep("decode textures", (Profiler::now() - start) / 1e6);
+        start = Profiler::now();
+        for (const MeshCache::MeshView& view : views)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            vector<Texture> textures;
+            for (const MeshCache::TextureRef& ref : view.textures)
+                textures.push_back(loadTexture(ref.path.c_str(), ref.type));
+            meshes.push_back(Mesh(view.vertices, view.vertexCount, vertexFormat, view.indices, view.indexCount, view.indexType,
+                textures, view.boundsMin, view.boundsMax, view.boundsRadius, view.lods, file));
+            countMesh(meshes.back());
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        importStats.addStep("upload", (Profiler::now() - start) / 1e6);
+        return true;
+    }
+
+    // the CPU side of one mesh, filled on a worker thread
+    struct ImportedMesh {
+        vector<Vertex> vertices;
+        vector<PackedVertex> packedVertices;
+        vector<unsigned int> indices;
+        vector<VertexBones> bones;      // empty for meshes without bones
+        MeshLodChain lods;
+        bool generatedTangents = false;
+    };
+
+    // images decoded ahead of their upload, see decodeTextures()
+    map<string, TextureImage> decodedImages;
+
+    // collects the meshes of a node and, recursively, of its children in the order they are drawn
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*>& sceneMeshes)
+    {
+        // the node object only contains indices to index the actual objects in the scene. 
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         for(unsigned int i = 0; i < node->mNumChildren; i++)
+            processNode(node->mChildren[i], scene, sceneMeshes);
+    }
+
+    // converts the meshes and decodes their textures on the shared thread pool, then creates the GL objects in
+    // node order on this thread, the only one allowed to talk to the context
+    void processMeshes(const vector<aiMesh*>& sceneMeshes, const aiScene *scene)
+    {
+        PROFILE_ZONE("Model::processMeshes");
+        vector<ImportedMesh> imported(sceneMeshes.size());
+        int64_t start = Profiler::now();
+        ThreadPool::shared().parallelFor(sceneMeshes.size(), [&](size_t i) {
+            processMesh(sceneMeshes[i], imported[i], i);
+        });
+        importStats.addStep("convert meshes", (Profiler::now() - start) / 1e6);
+        for (const ImportedMesh& mesh : imported)
+            importStats.missingTangents += mesh.generatedTangents ? 1 : 0;
+
+        vector<string> paths;
+        for (aiMesh* mesh : sceneMeshes)
+            materialTexturePaths(scene->mMaterials[mesh->mMaterialIndex], paths);
+        start = Profiler::now();
+        decodeTextures(paths);
+        importStats.addStep("decode textures", (Profiler::now() - start) / 1e6);
+
+        PROFILE_ZONE("Model::uploadMeshes");
+        start = Profiler::now();
+        meshes.reserve(meshes.size() + imported.size());
+        for (size_t i = 0; i < imported.size(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            vector<Texture> textures = loadMaterial(scene->mMaterials[sceneMeshes[i]->mMaterialIndex]);
+            if (vertexFormat == VERTEX_PACKED)
+                meshes.push_back(Mesh(std::move(imported[i].packedVertices), std::move(imported[i].indices), std::move(textures), std::move(imported[i].lods)));
+            else
+                meshes.push_back(Mesh(std::move(imported[i].vertices), std::move(imported[i].indices), std::move(textures), std::move(imported[i].lods)));
+            if (!imported[i].bones.empty())
+                meshes.back().setBones(std::move(imported[i].bones));
+            countMesh(meshes.back());
         }
+        importStats.addStep("upload", (Profiler::now() - start) / 1e6);
+    }
 
+    void countMesh(const Mesh& mesh)
+    {
+        importStats.meshes++;
+        importStats.vertices += mesh.vertexCount();
+        importStats.indices += mesh.lod(0).indexCount;
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // fills result from mesh, runs on the worker threads so it must not touch GL or the model's members.
+    // every attribute is copied in one pass over its Assimp array into the sized vertex buffer, the loops are
+    // plain float copies the compiler vectorizes.
+    void processMesh(const aiMesh *mesh, ImportedMesh& result, size_t number) const
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        PROFILE_ZONE("Model::processMesh");
+        vector<Vertex>& vertices = result.vertices;
+        vector<unsigned int>& indices = result.indices;
+        vertices.resize(mesh->mNumVertices);
+
+        copyAttribute(vertices, &Vertex::Position, mesh->mVertices);
+        copyAttribute(vertices, &Vertex::Normal, mesh->mNormals);
+        if (mesh->mTangents && mesh->mBitangents)
+        {
+            copyAttribute(vertices, &Vertex::Tangent, mesh->mTangents);
+            copyAttribute(vertices, &Vertex::Bitangent, mesh->mBitangents);
+        }
+        else
+        {
+            // aiProcess_CalcTangentSpace needs texture coordinates, without them any frame around the normal will do
+            for (Vertex& vertex : vertices)
+                tangentFrame(vertex);
+            result.generatedTangents = true;
+        }
+        // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+        // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+        const aiVector3D* texCoords = mesh->mTextureCoords[0];
+        for (size_t i = 0; i < vertices.size(); i++)
+            vertices[i].TexCoords = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f, 0.0f);
+
+        // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        size_t indexCount = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        indices.resize(indexCount);
+        unsigned int* index = indices.data();
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];
+            std::memcpy(index, face.mIndices, face.mNumIndices * sizeof(unsigned int));
+            index += face.mNumIndices;
+        }
+
+        // reorder for the vertex cache, overdraw and vertex fetch, then simplify into levels of detail
+        if (mesh->mNumBones > 0)
+        {
+            copyBones(mesh, result.bones);
+            optimizeSkinned(vertices, result.bones, indices, directory + " mesh " + std::to_string(number));
+        }
+        else
+            MeshOptimizer::optimize(vertices, indices, directory + " mesh " + std::to_string(number));
+        result.lods = MeshSimplifier::buildChain(vertices, indices, directory + " mesh " + std::to_string(number));
 
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        if (vertexFormat == VERTEX_PACKED)
+        {
+            result.packedVertices.resize(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++)
+                result.packedVertices[i] = packVertex(vertices[i]);
+            vector<Vertex>().swap(vertices);
+        }
+    }
+
+    // the four heaviest bones of every vertex with weights adding up to 1, ids are the skeleton's bone indices
+    void copyBones(const aiMesh *mesh, vector<VertexBones>& bones) const
+    {
+        bones.assign(mesh->mNumVertices, VertexBones{ { 0, 0, 0, 0 }, { 0.0f, 0.0f, 0.0f, 0.0f } });
+        for (unsigned int b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone* bone = mesh->mBones[b];
+            int id = skeleton.boneIndex(bone->mName.C_Str());
+            for (unsigned int w = 0; id >= 0 && w < bone->mNumWeights; w++)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
+                const aiVertexWeight& weight = bone->mWeights[w];
+                if (weight.mVertexId >= bones.size())
+                    continue;
+                // the empty or lightest slot, kept only if this bone weighs more
+                VertexBones& vertex = bones[weight.mVertexId];
+                int slot = 0;
+                for (int s = 1; s < 4; s++)
+                {
+                    if (vertex.Weights[s] < vertex.Weights[slot])
+                        slot = s;
+                }
+                if (weight.mWeight > vertex.Weights[slot])
+                {
+                    vertex.Ids[slot] = (uint16_t)id;
+                    vertex.Weights[slot] = weight.mWeight;
+                }
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
-        }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
-        }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        }
+        for (VertexBones& vertex : bones)
+        {
+            float total = vertex.Weights[0] + vertex.Weights[1] + vertex.Weights[2] + vertex.Weights[3];
+            for (int s = 0; s < 4 && total > 0.0f; s++)
+                vertex.Weights[s] /= total;
+        }
+    }
+
+    // MeshOptimizer::optimize() for a mesh with bones, which have to follow its vertices when they are reordered
+    static void optimizeSkinned(vector<Vertex>& vertices, vector<VertexBones>& bones, vector<unsigned int>& indices, const string& name)
+    {
+        struct TrackedVertex {
+            glm::vec3 Position;
+            unsigned int source;
+        };
+        vector<TrackedVertex> tracked(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            tracked[i] = { vertices[i].Position, (unsigned int)i };
+        MeshOptimizer::optimize(tracked, indices, name);
+        vector<Vertex> reorderedVertices(tracked.size());
+        vector<VertexBones> reorderedBones(tracked.size());
+        for (size_t i = 0; i < tracked.size(); i++)
+        {
+            reorderedVertices[i] = vertices[tracked[i].source];
+            reorderedBones[i] = bones[tracked[i].source];
+        }
+        vertices.swap(reorderedVertices);
+        bones.swap(reorderedBones);
+    }
 
+    // an arbitrary tangent and bitangent perpendicular to the normal
+    static void tangentFrame(Vertex& vertex)
+    {
+        glm::vec3 normal = glm::dot(vertex.Normal, vertex.Normal) > 0.0f ? glm::normalize(vertex.Normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+        glm::vec3 axis = std::abs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        vertex.Tangent = glm::normalize(glm::cross(axis, normal));
+        vertex.Bitangent = glm::cross(normal, vertex.Tangent);
+    }
+
+    // copies one vec3 attribute of every vertex, zero when the mesh doesn't have it
+    static void copyAttribute(vector<Vertex>& vertices, glm::vec3 Vertex::*attribute, const aiVector3D* source)
+    {
+        static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "aiVector3D has to be three floats");
+        if (!source)
+        {
+            for (Vertex& vertex : vertices)
+                vertex.*attribute = glm::vec3(0.0f);
+            return;
+        }
+        for (size_t i = 0; i < vertices.size(); i++)
+            std::memcpy(&(vertices[i].*attribute), &source[i], sizeof(glm::vec3));
+    }
+
+    // the textures of a material, in sampler order. we assume a convention for sampler names in the shaders. Each
+    // diffuse texture should be named as 'texture_diffuseN' where N is a sequential number ranging from 1 to
+    // MAX_SAMPLER_NUMBER. Same applies to other texture as the following list summarizes:
+    // diffuse: texture_diffuseN
+    // specular: texture_specularN
+    // normal: texture_normalN
+    vector<Texture> loadMaterial(aiMaterial *material)
+    {
+        vector<Texture> textures;
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return textures;
+    }
+
+    // appends the paths of every texture loadMaterial() would load
+    static void materialTexturePaths(aiMaterial *material, vector<string>& paths)
+    {
+        const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+        for (aiTextureType type : types)
+        {
+            for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+            {
+                aiString str;
+                material->GetTexture(type, i, &str);
+                paths.push_back(str.C_Str());
+            }
+        }
+    }
+
+    // decodes the images of paths on the shared thread pool, loadTexture() then only uploads them.
+    // paths the model or the texture cache already have and duplicates are skipped.
+    void decodeTextures(const vector<string>& paths)
+    {
+        vector<string> pending;
+        for (const string& path : paths)
+        {
+            bool known = decodedImages.count(path) > 0 || textureHandles.count(path) > 0
+                || TextureCache::shared().contains(texturePath(path), textureParams());
+            if (!known)
+            {
+                decodedImages[path] = TextureImage();
+                pending.push_back(path);
+            }
+        }
+        if (pending.empty())
+            return;
+        PROFILE_ZONE("Model::decodeTextures");
+        vector<TextureImage> images(pending.size());
+        ThreadPool::shared().parallelFor(pending.size(), [&](size_t i) {
+            images[i] = LoadTextureImage(texturePath(pending[i]));
+        });
+        for (size_t i = 0; i < pending.size(); i++)
+            decodedImages[pending[i]] = images[i];
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), textureType));
         }
         return textures;
     }
-};
 
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // the texture at path (relative to the model's directory), from the model itself, the texture cache or the file.
+    // decodeTextures() may have read the image already.
+    Texture loadTexture(const char *path, TextureType textureType)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        // the same image can serve as another map type
+        auto loaded = textureHandles.find(path);
+        if (loaded != textureHandles.end())
+            return Texture{ *loaded->second, textureType, path };
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureHandle handle;
+        auto decoded = decodedImages.find(path);
+        if (decoded != decodedImages.end())
+        {
+            handle = TextureCache::shared().upload(texturePath(path), decoded->second, textureParams());
+            decodedImages.erase(decoded);
+        }
+        else
+            handle = TextureCache::shared().load(texturePath(path), textureParams());
+        textureHandles[path] = handle;
+        Texture texture{ *handle, textureType, path };
+        textures_loaded.push_back(texture);
+        return texture;
+    }
 
-        stbi_image_free(data);
+    string texturePath(const string &path) const
+    {
+        return directory + '/' + path;
     }
-    else
+
+    TextureParams textureParams() const
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        TextureParams params;
+        params.gamma = gammaCorrection;
+        return params;
     }
+};
+
 
-    return textureID;
+TextureHandle TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    TextureParams params;
+    params.gamma = gamma;
+    return TextureCache::shared().load(directory + '/' + string(path), params);
 }
-#endif
\ No newline at end of file
+#endif
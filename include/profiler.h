@@ -0,0 +1,158 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Scoped CPU profiler that writes Chrome trace_event JSON (open it in chrome://tracing or ui.perfetto.dev).
+// Zones are recorded into a buffer owned by the recording thread, so recording takes no locks. Buffers are linked into a
+// global list once per thread with an atomic push. When recording is disabled a zone costs one relaxed atomic load.
+//
+//     void loadStuff()
+//     {
+//         PROFILE_ZONE("loadStuff");
+//         ...
+//     }
+//
+// Names must be string literals (or otherwise outlive the profiler), only the pointer is stored.
+// Building with DEMO_NO_PROFILER removes the zones completely.
+class Profiler
+{
+public:
+    struct Event {
+        const char* name;
+        int64_t start;      // ns since the profiler epoch
+        int64_t duration;   // ns, -1 for counters
+        double value;       // counters only
+    };
+
+    struct ThreadBuffer {
+        std::vector<Event> events;
+        unsigned int tid;
+        ThreadBuffer* next;
+    };
+
+    static void setEnabled(bool enable)
+    {
+        enabledFlag().store(enable, std::memory_order_relaxed);
+    }
+
+    static bool enabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    // ns since the first call, shared by every thread
+    static int64_t now()
+    {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static void zone(const char* name, int64_t start, int64_t end)
+    {
+        threadBuffer().events.push_back({ name, start, end - start, 0.0 });
+    }
+
+    // a value over time, shown as a graph in the trace viewer
+    static void counter(const char* name, double value)
+    {
+        if (!enabled())
+            return;
+        threadBuffer().events.push_back({ name, now(), -1, value });
+    }
+
+    // writes every recorded event. every other thread that records has to be done first: turn recording off with
+    // setEnabled(false), then stop or drain the threads, zones already open still record when they close.
+    static bool write(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::COULD_NOT_WRITE " << path << std::endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (ThreadBuffer* buffer = head().load(std::memory_order_acquire); buffer; buffer = buffer->next)
+        {
+            for (const Event& e : buffer->events)
+            {
+                file << (first ? "" : ",\n");
+                first = false;
+                if (e.duration < 0)
+                    file << "{\"name\":\"" << e.name << "\",\"ph\":\"C\",\"ts\":" << e.start / 1000.0
+                        << ",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"value\":" << e.value << "}}";
+                else
+                    file << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"ts\":" << e.start / 1000.0
+                        << ",\"dur\":" << e.duration / 1000.0 << ",\"pid\":1,\"tid\":" << buffer->tid << "}";
+            }
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return true;
+    }
+
+private:
+    static std::atomic<bool>& enabledFlag()
+    {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    static std::atomic<ThreadBuffer*>& head()
+    {
+        static std::atomic<ThreadBuffer*> list(nullptr);
+        return list;
+    }
+
+    // buffers are never freed so a trace can still be written after its thread has exited
+    static ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            static std::atomic<unsigned int> nextTid(1);
+            buffer = new ThreadBuffer();
+            buffer->events.reserve(1 << 16);
+            buffer->tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+            buffer->next = head().load(std::memory_order_relaxed);
+            while (!head().compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+        return *buffer;
+    }
+};
+
+// records the time between construction and destruction as a zone
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), start(Profiler::enabled() ? Profiler::now() : -1)
+    {
+    }
+
+    ~ProfileZone()
+    {
+        if (start >= 0)
+            Profiler::zone(name, start, Profiler::now());
+    }
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+#ifndef DEMO_NO_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+#endif
@@ -4,167 +4,375 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <globject.h>
+#include <glstate.h>
+#include <profiler.h>
+#include <shadercache.h>
+
+#include <cstdint>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <fstream>
-#include <sstream>
 #include <iostream>
 
+// GL_KHR_parallel_shader_compile, not part of the generated glad headers
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Owns its program, a Shader can be moved but not copied and deletes the program when it goes away.
 class Shader
 {
 public:
-    unsigned int ID;
+    GLProgram ID;
     // constructor generates the shader on the fly
+    // with deferred set the program is only submitted to the driver, see finish()
+    // defines are "#define NAME value" lines placed right after the #version line of every stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, bool deferred = false, const std::string& defines = "")
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
+        PROFILE_ZONE("Shader::Shader");
+        // 1. retrieve the vertex/fragment source code from filePath, resolving #include and injecting the defines
+        std::string vertexCode = preprocess(vertexPath, defines);
+        std::string fragmentCode = preprocess(fragmentPath, defines);
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        // if geometry shader path is present, also load a geometry shader
+        if(geometryPath != nullptr)
+            geometryCode = preprocess(geometryPath, defines);
+        // 2. try the program binary cache first
+        ID.reset(glCreateProgram());
+        cacheKey = ShaderCache::key(vertexCode, fragmentCode, geometryCode, defines);
+        if (ShaderCache::load(ID, cacheKey))
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            reflectUniforms();
+            return;
         }
+        compileStart = Profiler::now();
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 3. compile shaders, errors are checked in finish() so the driver can work on several programs at once
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        stages[0].reset(glCreateShader(GL_VERTEX_SHADER));
+        glShaderSource(stages[0], 1, &vShaderCode, NULL);
+        glCompileShader(stages[0]);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        stages[1].reset(glCreateShader(GL_FRAGMENT_SHADER));
+        glShaderSource(stages[1], 1, &fShaderCode, NULL);
+        glCompileShader(stages[1]);
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
         if(geometryPath != nullptr)
         {
             const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            stages[2].reset(glCreateShader(GL_GEOMETRY_SHADER));
+            glShaderSource(stages[2], 1, &gShaderCode, NULL);
+            glCompileShader(stages[2]);
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
+        for (const GLShader& stage : stages)
+        {
+            if (stage)
+                glAttachShader(ID, stage);
+        }
+        // glProgramParameteri is GL 4.1 / ARB_get_program_binary, glad leaves it null on a 3.3 context
+        if (ShaderCache::supported() && glProgramParameteri)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
+        pending = true;
+        if (!deferred)
+            finish();
+    }
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    Shader(Shader&&) = default;
+    Shader& operator=(Shader&&) = default;
+    // reads a shader file and resolves its #include "file" lines, paths are relative to the including file.
+    // every file is included once per stage, so shared blocks can include what they need without guards.
+    // defines are inserted after the #version line, which has to stay the first line of the source.
+    // ------------------------------------------------------------------------
+    static std::string preprocess(const std::string& path, const std::string& defines)
+    {
+        std::set<std::string> included;
+        std::string source = readSource(path, included);
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + "\n" + source;
+        return source.substr(0, lineEnd + 1) + defines + "\n" + source.substr(lineEnd + 1);
+    }
+    // asks the driver for as many compiler threads as it likes (GL_KHR_parallel_shader_compile).
+    // call once after loading GL, before creating deferred shaders. load is the proc loader given to glad.
+    // ------------------------------------------------------------------------
+    static bool enableParallelCompile(GLADloadproc load)
+    {
+        typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+        MaxShaderCompilerThreadsProc maxThreads = NULL;
+        if (hasExtension("GL_KHR_parallel_shader_compile"))
+            maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        else if (hasExtension("GL_ARB_parallel_shader_compile"))
+            maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        parallelCompile() = maxThreads != NULL;
+        if (maxThreads)
+            maxThreads(0xFFFFFFFF);
+        return parallelCompile();
+    }
+    // true once the program is linked. without parallel compile support there is no way to ask
+    // the driver, it reports ready and the first use may block.
+    // ------------------------------------------------------------------------
+    bool isReady() const
+    {
+        if (!pending || !parallelCompile())
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    // waits for a deferred program: checks errors, stores the binary and reflects the uniforms.
+    // use() and uniform() call this, so a deferred shader only blocks on its first use.
+    // ------------------------------------------------------------------------
+    void finish() const
+    {
+        if (!pending)
+            return;
+        PROFILE_ZONE("Shader::finish");
+        pending = false;
+        const char* types[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            if (stages[i])
+                checkCompileErrors(stages[i], types[i]);
+        }
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        for (GLShader& stage : stages)
+            stage.reset();
 
+        ShaderCache::save(ID, cacheKey, (float)((Profiler::now() - compileStart) / 1000000.0));
+        reflectUniforms();
     }
-    // activate the shader
+    // activate the shader, nothing reaches GL when it is already current
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        finish();
+        GLState::current().useProgram(ID);
+    }
+    // location of an active uniform, -1 if the program doesn't use it (setting -1 is a no-op in GL).
+    // resolve the handles once and pass them to the setters to skip the name lookup in hot loops.
+    // ------------------------------------------------------------------------
+    GLint uniform(const std::string &name) const
+    {
+        finish();
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second : -1;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(uniform(name), value);
+    }
+    void setBool(GLint location, bool value) const
+    {         
+        glUniform1i(location, (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(uniform(name), value);
+    }
+    void setInt(GLint location, int value) const
+    { 
+        glUniform1i(location, value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(uniform(name), value);
+    }
+    void setFloat(GLint location, float value) const
+    { 
+        glUniform1f(location, value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(uniform(name), value);
+    }
+    void setVec2(GLint location, const glm::vec2 &value) const
+    { 
+        glUniform2fv(location, 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(uniform(name), x, y);
+    }
+    void setVec2(GLint location, float x, float y) const
+    { 
+        glUniform2f(location, x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(uniform(name), value);
+    }
+    void setVec3(GLint location, const glm::vec3 &value) const
+    { 
+        glUniform3fv(location, 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(uniform(name), x, y, z);
+    }
+    void setVec3(GLint location, float x, float y, float z) const
+    { 
+        glUniform3f(location, x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(uniform(name), value);
+    }
+    void setVec4(GLint location, const glm::vec4 &value) const
+    { 
+        glUniform4fv(location, 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(uniform(name), x, y, z, w);
+    }
+    void setVec4(GLint location, float x, float y, float z, float w) const
+    { 
+        glUniform4f(location, x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
+    }
+    void setMat2(GLint location, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
+    }
+    void setMat3(GLint location, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name), mat);
+    }
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // active uniform name -> location, filled once after linking
+    mutable std::unordered_map<std::string, GLint> uniforms;
+    // state of a program that is still compiling
+    mutable bool pending = false;
+    mutable GLShader stages[3];
+    std::string cacheKey;
+    int64_t compileStart = 0;
+
+    static bool& parallelCompile()
+    {
+        static bool supported = false;
+        return supported;
+    }
+
+    static std::string readSource(const std::string& path, std::set<std::string>& included)
+    {
+        if (!included.insert(path).second)
+            return "";
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return "";
+        }
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::string source, line;
+        while (std::getline(file, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start);
+                size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+                if (close == std::string::npos)
+                {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ": " << line << std::endl;
+                    continue;
+                }
+                source += readSource(directory + line.substr(open + 1, close - open - 1), included);
+                continue;
+            }
+            source += line + "\n";
+        }
+        return source;
+    }
+
+    static bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::string(extension) == name)
+                return true;
+        }
+        return false;
+    }
+
+    // looks up every active uniform of the linked program. array elements are stored under both
+    // "name" and "name[i]", struct array members come out of GL one by one ("pointLights[1].diffuse").
+    // ------------------------------------------------------------------------
+    void reflectUniforms() const
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName(name.c_str(), length);
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            // members of uniform blocks have no location
+            if (location < 0)
+                continue;
+            uniforms[uniformName] = location;
+            size_t bracket = uniformName.size() >= 3 ? uniformName.rfind("[0]") : std::string::npos;
+            if (bracket != std::string::npos && bracket == uniformName.size() - 3)
+            {
+                std::string base = uniformName.substr(0, bracket);
+                uniforms[base] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniforms[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    void checkCompileErrors(GLuint shader, std::string type) const
     {
         GLint success;
         GLchar infoLog[1024];
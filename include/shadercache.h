@@ -0,0 +1,170 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <glad/glad.h>
+
+#include <profiler.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// A binary is stored under a hash of the shader sources, the defines and the driver vendor/renderer/version strings,
+// so editing a shader or updating the driver simply misses the cache. Drivers may still reject a binary they wrote
+// themselves; load() then fails and the caller compiles from source as usual.
+//
+// file layout: "GLPB", uint32 version, GLenum format, float compile ms, uint32 size, binary
+class ShaderCache
+{
+public:
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    static std::string& directory()
+    {
+        static std::string dir = "shadercache";
+        return dir;
+    }
+
+    // milliseconds of compiling and linking skipped thanks to the cache so far
+    static double& savedMs()
+    {
+        static double ms = 0.0;
+        return ms;
+    }
+
+    // needs a current context for the driver strings
+    static std::string key(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode, const std::string& defines)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        hash = fnv1a(hash, vertexCode);
+        hash = fnv1a(hash, fragmentCode);
+        hash = fnv1a(hash, geometryCode);
+        hash = fnv1a(hash, defines);
+        hash = fnv1a(hash, glString(GL_VENDOR));
+        hash = fnv1a(hash, glString(GL_RENDERER));
+        hash = fnv1a(hash, glString(GL_VERSION));
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return name;
+    }
+
+    // loads the cached binary into program. returns false when there is no usable binary,
+    // the program is left unlinked then and can be built from source.
+    static bool load(GLuint program, const std::string& key)
+    {
+        if (!supported())
+            return false;
+        PROFILE_ZONE("ShaderCache::load");
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        char magic[4];
+        uint32_t version = 0, size = 0;
+        GLenum format = 0;
+        float compileMs = 0.0f;
+        file.read(magic, 4);
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&format, sizeof(format));
+        file.read((char*)&compileMs, sizeof(compileMs));
+        file.read((char*)&size, sizeof(size));
+        if (!file || std::string(magic, 4) != "GLPB" || version != VERSION || size == 0)
+            return false;
+        std::vector<char> binary(size);
+        file.read(&binary[0], size);
+        if (!file)
+            return false;
+
+        int64_t start = Profiler::now();
+        glProgramBinary(program, format, &binary[0], (GLsizei)size);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            std::cout << "shader cache: binary " << key << " rejected by the driver, compiling from source" << std::endl;
+            return false;
+        }
+        double loadMs = (Profiler::now() - start) / 1000000.0;
+        if (compileMs > loadMs)
+            savedMs() += compileMs - loadMs;
+        Profiler::counter("shader cache saved ms", savedMs());
+        return true;
+    }
+
+    // stores the binary of a linked program, it has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    static void save(GLuint program, const std::string& key, float compileMs)
+    {
+        if (!supported())
+            return;
+        GLint success = 0, size = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (!success || size <= 0)
+            return;
+        std::vector<char> binary(size);
+        GLenum format = 0;
+        GLsizei length = 0;
+        glGetProgramBinary(program, size, &length, &format, &binary[0]);
+        if (length <= 0)
+            return;
+
+        std::error_code error;
+        std::filesystem::create_directories(directory(), error);
+        std::ofstream file(path(key), std::ios::binary);
+        if (!file)
+            return;
+        uint32_t version = VERSION, binarySize = (uint32_t)length;
+        file.write("GLPB", 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&format, sizeof(format));
+        file.write((const char*)&compileMs, sizeof(compileMs));
+        file.write((const char*)&binarySize, sizeof(binarySize));
+        file.write(&binary[0], length);
+    }
+
+    // the driver has to offer at least one binary format, and the entry points have to be loaded
+    static bool supported()
+    {
+        if (!enabled() || !glGetProgramBinary || !glProgramBinary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+
+    static std::string path(const std::string& key)
+    {
+        return directory() + "/" + key + ".bin";
+    }
+
+    static std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        return value ? (const char*)value : "";
+    }
+
+    static uint64_t fnv1a(uint64_t hash, const std::string& text)
+    {
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        // separator so ("ab", "c") and ("a", "bc") hash differently
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+        return hash;
+    }
+};
+#endif
@@ -0,0 +1,103 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <shader.h>
+#include <uniformblocks.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <tuple>
+
+// The compile-time switches of the lit shader (project.fs). Every combination is a separate program,
+// so a draw only pays for the lights and maps it really has instead of branching on uniforms.
+struct ShaderPermutation {
+    unsigned int pointLights = MAX_POINT_LIGHTS;   // the first pointLights entries of the Lights block are evaluated
+    bool spotLight = true;
+    bool specularMap = true;                       // without one the specular term is dropped
+    bool lodDither = false;                        // screen-door fade between levels of detail, see lodselect.h
+    bool instanced = false;                        // per-instance model matrices at attributes 5-8, see asteroidbelt.h
+    bool skinned = false;                          // bones at attributes 9-10 move the vertices, see skinning.h
+
+    std::string defines() const
+    {
+        return "#define NR_POINT_LIGHTS " + std::to_string(pointLights) + "\n"
+            + "#define SPOT_LIGHT " + (spotLight ? "1" : "0") + "\n"
+            + "#define SPECULAR_MAP " + (specularMap ? "1" : "0") + "\n"
+            + "#define LOD_DITHER " + (lodDither ? "1" : "0") + "\n"
+            + "#define INSTANCED " + (instanced ? "1" : "0") + "\n"
+            + "#define SKINNED " + (skinned ? "1" : "0");
+    }
+
+    bool operator<(const ShaderPermutation& other) const
+    {
+        return std::tie(pointLights, spotLight, specularMap, lodDither, instanced, skinned)
+            < std::tie(other.pointLights, other.spotLight, other.specularMap, other.lodDither, other.instanced, other.skinned);
+    }
+};
+
+// Lazily built variants of one vertex/fragment pair.
+// prepare() submits a variant to the driver without waiting for it, get() returns it ready to use.
+// setup runs once per variant on its first get(), put sampler units and block bindings there.
+class ShaderVariants
+{
+public:
+    ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath, std::function<void(Shader&)> setup = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), setup(setup)
+    {
+    }
+
+    void prepare(const ShaderPermutation& permutation)
+    {
+        if (variants.find(permutation) != variants.end())
+            return;
+        variants.emplace(std::piecewise_construct, std::forward_as_tuple(permutation),
+            std::forward_as_tuple(vertexPath.c_str(), fragmentPath.c_str(), nullptr, true, permutation.defines()));
+    }
+
+    Shader& get(const ShaderPermutation& permutation)
+    {
+        prepare(permutation);
+        Variant& variant = variants.at(permutation);
+        if (!variant.ready)
+        {
+            variant.ready = true;
+            variant.shader.finish();
+            if (setup)
+            {
+                variant.shader.use();
+                setup(variant.shader);
+            }
+        }
+        return variant.shader;
+    }
+
+    // calls f on every variant built so far, e.g. to change a uniform they all share
+    void forEach(const std::function<void(Shader&)>& f)
+    {
+        for (auto& entry : variants)
+            f(get(entry.first));
+    }
+
+    size_t size() const
+    {
+        return variants.size();
+    }
+
+private:
+    struct Variant {
+        Shader shader;
+        bool ready = false;
+
+        Variant(const char* vertexPath, const char* fragmentPath, const char* geometryPath, bool deferred, const std::string& defines)
+            : shader(vertexPath, fragmentPath, geometryPath, deferred, defines)
+        {
+        }
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::function<void(Shader&)> setup;
+    std::map<ShaderPermutation, Variant> variants;
+};
+#endif
@@ -0,0 +1,251 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <mesh.h>
+#include <model.h>
+#include <shader.h>
+#include <globject.h>
+#include <glstate.h>
+#include <profiler.h>
+#include <threadpool.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKINNING_SSE 1
+#else
+#define SKINNING_SSE 0
+#endif
+
+// The bone matrices of any number of characters in one texture buffer, four RGBA32F texels per matrix. The skinned
+// permutation of project.vs reads the matrices of the drawn character from bonePalette starting at boneBase, so a
+// frame uploads every palette once and each draw only changes an integer uniform.
+//
+//     palette.upload(matrices);                 // characters * boneCount matrices
+//     palette.bind();
+//     shader.setInt(boneBaseLoc, character * boneCount);
+class BonePalette
+{
+public:
+    // out of the way of the material textures (see textureUnit()), point the bonePalette sampler here
+    static const unsigned int UNIT = 15;
+
+    // replaces the matrices, the buffer grows as needed
+    void upload(const glm::mat4* matrices, size_t count)
+    {
+        PROFILE_ZONE("BonePalette::upload");
+        if (!buffer)
+        {
+            buffer = GLBuffer::create();
+            texture = GLTexture::create();
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (count > capacity)
+        {
+            capacity = count;
+            glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), matrices, GL_STREAM_DRAW);
+            GLState::current().bindTexture(UNIT, GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        }
+        else
+        {
+            // orphan the old storage instead of waiting for draws still reading it
+            glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(glm::mat4), matrices);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void upload(const std::vector<glm::mat4>& matrices)
+    {
+        upload(matrices.data(), matrices.size());
+    }
+
+    void bind() const
+    {
+        GLState::current().bindTexture(UNIT, GL_TEXTURE_BUFFER, texture);
+    }
+
+private:
+    GLBuffer buffer;
+    GLTexture texture;
+    size_t capacity = 0;
+};
+
+// The reference the GPU path is measured against: skins the meshes of a model on the CPU, every character's vertices
+// into one streamed buffer, and draws them with the unskinned shader. Characters are spread over the shared thread
+// pool, and each vertex blends its four bone matrices and transforms position and normal with SSE, four floats at a
+// time (plain floats on other CPUs). Only positions, normals and texture coordinates are written, project.vs
+// doesn't read the tangent frame.
+// The constructor copies what it needs from the meshes, they must still have their CPU copies and bones.
+class CpuSkinner
+{
+public:
+    explicit CpuSkinner(Model& model)
+    {
+        for (Mesh& mesh : model.meshes)
+        {
+            if (mesh.bones.empty() || !mesh.loadCpuCopies())
+            {
+                std::cout << "ERROR::CPUSKINNER::MESH_WITHOUT_BONES" << std::endl;
+                continue;
+            }
+            parts.emplace_back();
+            Part& part = parts.back();
+            part.mesh = &mesh;
+            part.source.resize(mesh.vertexCount());
+            for (size_t i = 0; i < part.source.size(); i++)
+            {
+                glm::vec3 position = mesh.format == VERTEX_PACKED ? mesh.packedVertices[i].Position : mesh.vertices[i].Position;
+                glm::vec3 normal = mesh.format == VERTEX_PACKED ? unpackNormal(mesh.packedVertices[i].Normal) : mesh.vertices[i].Normal;
+                glm::vec2 texCoords = mesh.format == VERTEX_PACKED
+                    ? glm::vec2(glm::unpackHalf1x16(mesh.packedVertices[i].TexCoords[0]), glm::unpackHalf1x16(mesh.packedVertices[i].TexCoords[1]))
+                    : mesh.vertices[i].TexCoords;
+                part.source[i] = { glm::vec4(position, 1.0f), glm::vec4(normal, 0.0f), texCoords };
+            }
+            part.bones = mesh.bones;
+            part.indexCount = (unsigned int)mesh.indices.size();
+
+            part.VAO = GLVertexArray::create();
+            part.VBO = GLBuffer::create();
+            part.EBO = GLBuffer::create();
+            GLState::current().bindVertexArray(part.VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, part.VBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, part.EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, TexCoords));
+            GLState::current().bindVertexArray(0);
+        }
+    }
+
+    // skins count characters, palettes holds boneCount matrices per character one after the other
+    void skin(const glm::mat4* palettes, unsigned int boneCount, unsigned int count)
+    {
+        PROFILE_ZONE("CpuSkinner::skin");
+        characters = count;
+        for (Part& part : parts)
+        {
+            part.skinned.resize(part.source.size() * count);
+            ThreadPool::shared().parallelFor(count, [&](size_t character) {
+                skinVertices(part, palettes + character * boneCount, &part.skinned[character * part.source.size()]);
+            });
+            glBindBuffer(GL_ARRAY_BUFFER, part.VBO);
+            glBufferData(GL_ARRAY_BUFFER, part.skinned.size() * sizeof(SkinnedVertex), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, part.skinned.size() * sizeof(SkinnedVertex), part.skinned.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draws one character of the last skin(), the shader has to be in use with the character's model matrix
+    void draw(Shader& shader, unsigned int character)
+    {
+        if (character >= characters)
+            return;
+        for (Part& part : parts)
+        {
+            part.mesh->bindTextures(shader);
+            GLState::current().bindVertexArray(part.VAO);
+            glDrawElementsBaseVertex(GL_TRIANGLES, part.indexCount, GL_UNSIGNED_INT, (void*)0, (GLint)(character * part.source.size()));
+        }
+    }
+
+    // vertices skinned per character
+    size_t vertexCount() const
+    {
+        size_t count = 0;
+        for (const Part& part : parts)
+            count += part.source.size();
+        return count;
+    }
+
+private:
+    // the bind pose, position w is 1 and normal w 0 so one loop transforms both
+    struct SourceVertex {
+        glm::vec4 Position;
+        glm::vec4 Normal;
+        glm::vec2 TexCoords;
+    };
+
+    struct SkinnedVertex {
+        glm::vec3 Position;
+        glm::vec3 Normal;
+        glm::vec2 TexCoords;
+    };
+
+    struct Part {
+        Mesh* mesh;
+        std::vector<SourceVertex> source;
+        std::vector<VertexBones> bones;
+        std::vector<SkinnedVertex> skinned;   // every character's vertices, uploaded to VBO
+        unsigned int indexCount = 0;
+        GLVertexArray VAO;
+        GLBuffer VBO, EBO;
+    };
+    std::vector<Part> parts;
+    unsigned int characters = 0;
+
+    static glm::vec3 unpackNormal(uint32_t packed)
+    {
+        return glm::vec3(glm::unpackSnorm3x10_1x2(packed));
+    }
+
+    // the vertices of one part for one character's palette
+    static void skinVertices(const Part& part, const glm::mat4* palette, SkinnedVertex* out)
+    {
+        for (size_t i = 0; i < part.source.size(); i++)
+        {
+            const SourceVertex& vertex = part.source[i];
+            const VertexBones& bones = part.bones[i];
+#if SKINNING_SSE
+            // the weighted sum of the bone matrices, one column per register
+            __m128 columns[4];
+            for (int c = 0; c < 4; c++)
+                columns[c] = _mm_setzero_ps();
+            for (int b = 0; b < 4; b++)
+            {
+                if (bones.Weights[b] == 0.0f)
+                    continue;
+                __m128 weight = _mm_set1_ps(bones.Weights[b]);
+                const float* matrix = &palette[bones.Ids[b]][0][0];
+                for (int c = 0; c < 4; c++)
+                    columns[c] = _mm_add_ps(columns[c], _mm_mul_ps(weight, _mm_loadu_ps(matrix + c * 4)));
+            }
+            __m128 position = _mm_mul_ps(columns[0], _mm_set1_ps(vertex.Position.x));
+            position = _mm_add_ps(position, _mm_mul_ps(columns[1], _mm_set1_ps(vertex.Position.y)));
+            position = _mm_add_ps(position, _mm_mul_ps(columns[2], _mm_set1_ps(vertex.Position.z)));
+            position = _mm_add_ps(position, columns[3]);
+            __m128 normal = _mm_mul_ps(columns[0], _mm_set1_ps(vertex.Normal.x));
+            normal = _mm_add_ps(normal, _mm_mul_ps(columns[1], _mm_set1_ps(vertex.Normal.y)));
+            normal = _mm_add_ps(normal, _mm_mul_ps(columns[2], _mm_set1_ps(vertex.Normal.z)));
+            float p[4], n[4];
+            _mm_storeu_ps(p, position);
+            _mm_storeu_ps(n, normal);
+            out[i].Position = glm::vec3(p[0], p[1], p[2]);
+            out[i].Normal = glm::vec3(n[0], n[1], n[2]);
+#else
+            glm::mat4 skin(0.0f);
+            for (int b = 0; b < 4; b++)
+            {
+                if (bones.Weights[b] != 0.0f)
+                    skin += palette[bones.Ids[b]] * bones.Weights[b];
+            }
+            out[i].Position = glm::vec3(skin * vertex.Position);
+            out[i].Normal = glm::vec3(skin * vertex.Normal);
+#endif
+            out[i].TexCoords = vertex.TexCoords;
+        }
+    }
+};
+#endif
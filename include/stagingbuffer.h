@@ -0,0 +1,71 @@
+#ifndef STAGINGBUFFER_H
+#define STAGINGBUFFER_H
+
+#include <glad/glad.h>
+
+#include <globject.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// A GL_PIXEL_UNPACK_BUFFER texture uploads copy their pixels into: glTexImage*() then reads from the buffer instead
+// of client memory, so the driver can move the pixels into the texture later instead of before the call returns.
+// The storage is orphaned on every stage(), a new upload never waits for the GPU to finish reading the last one.
+// current() is per thread, the asset loader installs one for its upload context (see assetloader.h). Where it is
+// null, like on the render thread, TextureFromImage() and loadCubemap() upload from client memory as before.
+//
+//     const void* pixels = staging.stage(data, bytes);    // the buffer stays bound, pixels is an offset into it
+//     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+//     staging.unbind();
+class StagingBuffer
+{
+public:
+    static StagingBuffer*& current()
+    {
+        static thread_local StagingBuffer* buffer = nullptr;
+        return buffer;
+    }
+
+    // copies bytes of data into the buffer and leaves it bound to GL_PIXEL_UNPACK_BUFFER. returns what to pass as the
+    // pixels of the upload, data itself if mapping failed and the buffer is unbound again.
+    const void* stage(const void* data, size_t bytes)
+    {
+        if (!buffer)
+            buffer = GLBuffer::create();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        capacity = std::max(capacity, bytes);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped)
+        {
+            std::memcpy(mapped, data, bytes);
+            // false when the storage got lost while mapped, e.g. by a mode switch
+            if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            {
+                staged += bytes;
+                return (const void*)0;
+            }
+        }
+        std::cout << "ERROR::STAGINGBUFFER::MAP_FAILED" << std::endl;
+        unbind();
+        return data;
+    }
+
+    void unbind()
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // bytes that went through the buffer so far
+    size_t bytesStaged() const
+    {
+        return staged;
+    }
+
+private:
+    GLBuffer buffer;
+    size_t capacity = 0;
+    size_t staged = 0;
+};
+#endif
@@ -0,0 +1,231 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <globject.h>
+#include <glstate.h>
+#include <profiler.h>
+#include <stagingbuffer.h>
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// pixels of an image file, decoded apart from the upload so it can happen on another thread
+struct TextureImage {
+    unsigned char* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int nrComponents = 0;
+};
+
+// how a texture is sampled and stored, the same file with other parameters is another texture
+struct TextureParams {
+    GLenum wrap = GL_REPEAT;
+    GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    bool gamma = false;     // sRGB storage for color maps, one and two channel images ignore it
+};
+
+// a texture shared by everyone who loaded it, deleted with the last handle
+typedef std::shared_ptr<const GLTexture> TextureHandle;
+
+// decodes the image at path, safe on any thread
+inline TextureImage LoadTextureImage(const std::string& path)
+{
+    PROFILE_ZONE("LoadTextureImage");
+    TextureImage image;
+    image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    return image;
+}
+
+// creates the texture from image and frees its pixels, needs the GL context. a failed decode leaves an empty texture.
+inline GLTexture TextureFromImage(TextureImage& image, const std::string& path, const TextureParams& params = TextureParams())
+{
+    PROFILE_ZONE("TextureFromImage");
+    GLTexture texture = GLTexture::create();
+
+    if (image.data)
+    {
+        GLenum format = GL_RGBA;
+        if (image.nrComponents == 1)
+            format = GL_RED;
+        else if (image.nrComponents == 2)
+            format = GL_RG;
+        else if (image.nrComponents == 3)
+            format = GL_RGB;
+        GLenum internalFormat = format;
+        if (params.gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (params.gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+
+        GLState::current().bindTexture(0, GL_TEXTURE_2D, texture);
+        // rows of one and three channel images aren't 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        const void* pixels = image.data;
+        StagingBuffer* staging = StagingBuffer::current();
+        if (staging)
+            pixels = staging->stage(image.data, (size_t)image.width * image.height * image.nrComponents);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        if (staging)
+            staging->unbind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, params.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, params.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.magFilter);
+    }
+    else
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+
+    stbi_image_free(image.data);
+    image.data = nullptr;
+    return texture;
+}
+
+// Every 2D texture of the process by canonical path and parameters. A file loaded again, by another model or by
+// the demo, gets the texture of the first load instead of being decoded and uploaded again. The cache only holds
+// weak references: a texture lives as long as some handle to it does.
+// The render thread and the asset loader (see assetloader.h) share the cache, their contexts share the textures, so
+// every call takes a lock. Decoding happens outside of it, load() looks the file up, decodes it unlocked and checks
+// again before inserting. Images can be decoded anywhere beforehand with LoadTextureImage() and handed to upload().
+class TextureCache
+{
+public:
+    static TextureCache& shared()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // off: every load decodes and uploads, e.g. to measure what the cache saves
+    static bool& enabled()
+    {
+        static bool flag = true;
+        return flag;
+    }
+
+    // the texture of path, decoded and uploaded if nobody holds it yet
+    TextureHandle load(const std::string& path, const TextureParams& params = TextureParams())
+    {
+        std::string name = key(path, params);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TextureHandle texture = find(name);
+            if (texture)
+                return texture;
+        }
+        // another thread may load the same file meanwhile, uploadDecoded() keeps whichever texture came first
+        TextureImage image = LoadTextureImage(path);
+        return uploadDecoded(name, path, image, params);
+    }
+
+    // like load() with the image already decoded, image is freed either way
+    TextureHandle upload(const std::string& path, TextureImage& image, const TextureParams& params = TextureParams())
+    {
+        return uploadDecoded(key(path, params), path, image, params);
+    }
+
+    // true if a texture for path and params is alive, decoding it again would be wasted
+    bool contains(const std::string& path, const TextureParams& params = TextureParams()) const
+    {
+        if (!enabled())
+            return false;
+        std::string name = key(path, params);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = textures.find(name);
+        return entry != textures.end() && !entry->second.expired();
+    }
+
+    // loads answered from the cache and loads that created a texture
+    unsigned int hits() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hitCount;
+    }
+
+    unsigned int misses() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return missCount;
+    }
+
+    // textures alive
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (const auto& entry : textures)
+            count += entry.second.expired() ? 0 : 1;
+        return count;
+    }
+
+    // the same file reached by different relative paths gives the same string, missing files are normalized lexically
+    static std::string canonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        if (error)
+            canonical = std::filesystem::path(path).lexically_normal();
+        return canonical.generic_string();
+    }
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<const GLTexture>> textures;
+    mutable std::mutex mutex;
+    unsigned int hitCount = 0;
+    unsigned int missCount = 0;
+
+    static std::string key(const std::string& path, const TextureParams& params)
+    {
+        return canonicalPath(path) + "|" + std::to_string(params.wrap) + "|" + std::to_string(params.minFilter) + "|"
+            + std::to_string(params.magFilter) + "|" + (params.gamma ? "srgb" : "linear");
+    }
+
+    TextureHandle find(const std::string& name)
+    {
+        if (!enabled())
+            return TextureHandle();
+        auto entry = textures.find(name);
+        if (entry == textures.end())
+            return TextureHandle();
+        TextureHandle texture = entry->second.lock();
+        if (texture)
+            hitCount++;
+        else
+            textures.erase(entry);
+        return texture;
+    }
+
+    TextureHandle uploadDecoded(const std::string& name, const std::string& path, TextureImage& image, const TextureParams& params)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        TextureHandle texture = find(name);
+        if (texture)
+        {
+            stbi_image_free(image.data);
+            image.data = nullptr;
+            return texture;
+        }
+        return insert(name, TextureFromImage(image, path, params));
+    }
+
+    TextureHandle insert(const std::string& name, GLTexture texture)
+    {
+        missCount++;
+        TextureHandle handle = std::make_shared<const GLTexture>(std::move(texture));
+        if (enabled())
+            textures[name] = handle;
+        return handle;
+    }
+};
+#endif
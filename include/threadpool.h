@@ -0,0 +1,156 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from one queue. parallelFor() is the usual entry point, it splits an index range
+// over the workers and the calling thread and returns when every index is done. Tasks must not touch GL, only the
+// thread owning the context may.
+class ThreadPool
+{
+public:
+    // worker threads besides the caller, 0 makes parallelFor() run everything on the calling thread
+    explicit ThreadPool(unsigned int workerCount)
+    {
+        for (unsigned int i = 0; i < workerCount; i++)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // threads the shared pool works with, the caller included. 0 means one per hardware thread.
+    // only has an effect before the first call of shared().
+    static unsigned int& sharedThreads()
+    {
+        static unsigned int threads = 0;
+        return threads;
+    }
+
+    // the pool shared by the loaders
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool(defaultWorkers());
+        return pool;
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // calls f(i) for every i in [0, count), indices are handed out one at a time so uneven work balances itself
+    void parallelFor(size_t count, const std::function<void(size_t)>& f)
+    {
+        if (count == 0)
+            return;
+        if (count == 1)
+        {
+            f(0);
+            return;
+        }
+        // helpers can start after the last index is taken and the call returned, they only touch the shared state then
+        struct State {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::mutex mutex;
+            std::condition_variable allDone;
+        };
+        std::shared_ptr<State> state = std::make_shared<State>();
+        const std::function<void(size_t)>* body = &f;
+        auto run = [state, body, count]() {
+            size_t finished = 0;
+            for (size_t i = state->next.fetch_add(1); i < count; i = state->next.fetch_add(1))
+            {
+                (*body)(i);
+                finished++;
+            }
+            if (finished && state->done.fetch_add(finished) + finished == count)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->allDone.notify_all();
+            }
+        };
+        size_t helpers = std::min((size_t)size(), count - 1);
+        for (size_t i = 0; i < helpers; i++)
+            submit(run);
+        run();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->allDone.wait(lock, [&]() { return state->done.load() == count; });
+    }
+
+    // blocks until the queue is empty and no task is running
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return tasks.empty() && running == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    static unsigned int defaultWorkers()
+    {
+        unsigned int threads = sharedThreads() ? sharedThreads() : std::thread::hardware_concurrency();
+        return threads > 1 ? threads - 1 : 0;
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                running++;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+                if (tasks.empty() && running == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+};
+#endif
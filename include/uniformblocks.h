@@ -0,0 +1,127 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <globject.h>
+
+#include <cstring>
+#include <vector>
+
+// Per-frame state shared by every program through std140 uniform blocks:
+//     Camera (binding 0): projection, view, viewPos
+//     Lights (binding 1): dirLight, pointLights[MAX_POINT_LIGHTS], spotLight
+// The GLSL side is shaders/common/camera.glsl and shaders/common/lights.glsl.
+// Both blocks live in one buffer and are uploaded with a single write per frame.
+// The structs below mirror the GLSL declarations byte for byte, a vec3 followed by a float packs into one
+// 16 byte std140 slot, so keep the member order in sync with the shaders.
+
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+const unsigned int MAX_POINT_LIGHTS = 3;
+
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad;
+};
+
+struct DirLightBlock {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct PointLightBlock {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float pad;
+};
+
+struct SpotLightBlock {
+    glm::vec3 direction;
+    float cutOff;
+    glm::vec3 position;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+struct LightsBlock {
+    DirLightBlock dirLight;
+    PointLightBlock pointLights[MAX_POINT_LIGHTS];
+    SpotLightBlock spotLight;
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 Camera block");
+static_assert(sizeof(LightsBlock) == 64 + 64 * MAX_POINT_LIGHTS + 80, "LightsBlock must match the std140 Lights block");
+
+class FrameUniforms
+{
+public:
+    GLBuffer ID;
+    // CPU copies, edit them during the frame and upload() once before drawing
+    CameraBlock camera = {};
+    LightsBlock lights = {};
+
+    // needs a current context
+    void init()
+    {
+        // the lights block has to start at a multiple of the buffer offset alignment
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = ((sizeof(CameraBlock) + alignment - 1) / alignment) * alignment;
+        staging.resize(lightsOffset + sizeof(LightsBlock));
+
+        ID = GLBuffer::create();
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ID, 0, sizeof(CameraBlock));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, ID, lightsOffset, sizeof(LightsBlock));
+    }
+
+    // points the program's Camera/Lights blocks at the shared binding points, programs without them are skipped
+    void attach(const Shader& shader) const
+    {
+        shader.finish();
+        GLuint cameraIndex = glGetUniformBlockIndex(shader.ID, "Camera");
+        if (cameraIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, cameraIndex, CAMERA_BLOCK_BINDING);
+        GLuint lightsIndex = glGetUniformBlockIndex(shader.ID, "Lights");
+        if (lightsIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, lightsIndex, LIGHTS_BLOCK_BINDING);
+    }
+
+    // orphans the buffer and writes both blocks in one call so the driver never waits for last frame's draws
+    void upload()
+    {
+        std::memcpy(&staging[0], &camera, sizeof(CameraBlock));
+        std::memcpy(&staging[lightsOffset], &lights, sizeof(LightsBlock));
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), &staging[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    size_t lightsOffset = 0;
+    std::vector<char> staging;
+};
+#endif
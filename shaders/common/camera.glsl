@@ -0,0 +1,7 @@
+// per-frame camera state, binding 0 (see uniformblocks.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
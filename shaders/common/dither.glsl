@@ -0,0 +1,13 @@
+// screen-door fade between two levels of detail (see lodselect.h). lodFade > 0 keeps that share of a 4x4 ordered
+// pattern, lodFade < 0 keeps the rest of the pattern of -lodFade, so two draws with f and -f cover every pixel once.
+// only compiled into the LOD_DITHER variants, discard would cost the other draws their early depth test.
+uniform float lodFade;
+
+void LodDither()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 cell = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (bayer[cell.y * 4 + cell.x] + 0.5) / 16.0;
+    if (lodFade > 0.0 ? threshold >= lodFade : threshold < -lodFade)
+        discard;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+#ifndef LOD_DITHER
+#define LOD_DITHER 0
+#endif
+#if LOD_DITHER
+#include "common/dither.glsl"
+#endif
+
+// depth only, color writes are masked off while this runs
+void main()
+{
+#if LOD_DITHER
+    LodDither();
+#endif
+}
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+#include "common/camera.glsl"
+
+// the lit pass draws the same geometry with GL_LEQUAL against this depth, both must compute identical positions
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
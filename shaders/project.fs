@@ -1,4 +1,19 @@
 #version 330 core
+// permutation, the loader defines these per variant (see ShaderPermutation in shadervariants.h).
+// the defaults evaluate everything.
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+#ifndef SPECULAR_MAP
+#define SPECULAR_MAP 1
+#endif
+#ifndef LOD_DITHER
+#define LOD_DITHER 0
+#endif
+
 out vec4 FragColor;
 
 in vec3 Normal;
@@ -11,47 +26,12 @@ struct Material {
     float shininess;
 };
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 direction;
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    float cutOff;
-    float outerCutOff;
-};
-
-struct PointLight {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-#define NR_POINT_LIGHTS 3   
+#include "common/camera.glsl"
+#include "common/lights.glsl"
+#if LOD_DITHER
+#include "common/dither.glsl"
+#endif
 
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform vec3 viewPos;
 uniform Material material;
 
 vec3 CalcAmbient(vec3 ambient);
@@ -65,17 +45,24 @@ vec3 CalSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {
+#if LOD_DITHER
+    LodDither();
+#endif
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
     //direct lightning
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
     //pointlights
+#if NR_POINT_LIGHTS > 0
     for (int i = 0; i < NR_POINT_LIGHTS; i++)
     {
         result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
     }
+#endif
     //spotlight
+#if SPOT_LIGHT
     result += CalSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
 
     //combined
     FragColor = vec4(result, 1.0);
@@ -138,12 +125,17 @@ vec3 CalcDiffuse(vec3 diffuse, vec3 lightDir, vec3 normal)
 
 vec3 CalcSpecular(vec3 specular, vec3 lightDir, vec3 normal, vec3 viewDir)
 {
+#if !SPECULAR_MAP
+    //materials without a specular map have no highlights
+    return vec3(0.0);
+#else
     vec3 halfwayDir = normalize(lightDir + viewDir);
     vec3 reflectDir = reflect(-lightDir, normal);
 
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
     //float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     return (spec * specular * vec3(texture(material.specular, TexCoords)));
+#endif
 }
 
 float CalcAttenuation(vec3 position, vec3 fragPos, float constant, float linear, float quadratic)
@@ -1,22 +1,65 @@
 #version 330 core
+// permutation, see ShaderPermutation in shadervariants.h
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+#ifndef SKINNED
+#define SKINNED 0
+#endif
+
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#if INSTANCED
+// per instance, placed inside model (see Mesh::setInstanceBuffer)
+layout (location = 5) in mat4 aInstanceModel;
+#endif
+#if SKINNED
+// up to 4 bones per vertex (see Mesh::setBones), their matrices come from the palette of every character drawn this
+// frame, four texels each (see BonePalette in skinning.h)
+layout (location = 9) in uvec4 aBoneIds;
+layout (location = 10) in vec4 aBoneWeights;
+uniform samplerBuffer bonePalette;
+uniform int boneBase;   // the drawn character's first matrix
+
+mat4 bone(uint id)
+{
+	int texel = (boneBase + int(id)) * 4;
+	return mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+		texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3));
+}
+#endif
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/camera.glsl"
 //uniform mat3 normalMatrix;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
 
+// must match the depth pre-pass (depth.vs) exactly
+invariant gl_Position;
+
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
-	FragPos = vec3(model * vec4(aPos, 1.0));
+#if INSTANCED
+	mat4 world = model * aInstanceModel;
+#else
+	mat4 world = model;
+#endif
+#if SKINNED
+	mat4 skin = bone(aBoneIds.x) * aBoneWeights.x + bone(aBoneIds.y) * aBoneWeights.y
+		+ bone(aBoneIds.z) * aBoneWeights.z + bone(aBoneIds.w) * aBoneWeights.w;
+	vec4 position = skin * vec4(aPos, 1.0);
+	vec3 normal = mat3(skin) * aNormal;
+#else
+	vec4 position = vec4(aPos, 1.0);
+	vec3 normal = aNormal;
+#endif
+	gl_Position = projection * view * world * position;
+	FragPos = vec3(world * position);
 	//Normal = normalMatrix * aNormal;
-	Normal = mat3(transpose(inverse(mat3(model)))) * aNormal;
+	Normal = mat3(transpose(inverse(mat3(world)))) * normal;
 	TexCoords = aTexCoords;
 }
\ No newline at end of file
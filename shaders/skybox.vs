@@ -3,8 +3,7 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "common/camera.glsl"
 
 void main()
 {
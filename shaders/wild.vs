@@ -4,8 +4,7 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/camera.glsl"
 uniform mat4 shear;
 
 out vec2 TexCoords;